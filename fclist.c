@@ -0,0 +1,325 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "gear.h"
+
+#define FCLIST_BUCKET 16
+
+/* The first string of each bucket is stored in full (NULL-terminated),
+   at $data + $heads[b].  Each of the others follows the one before it
+   as a varint (the length of the prefix it shares with that string),
+   and the rest of the string, NULL-terminated. */
+struct fclist {
+	size_t  num;     /* number of strings */
+	size_t  bucket;  /* strings per bucket */
+	size_t *heads;   /* offset of the first string of each bucket */
+	char   *data;
+	size_t  len;     /* bytes in $data */
+};
+
+/* Length of the common prefix of $a and $b. */
+static size_t _lcp(const char *a, const char *b)
+{
+	size_t n;
+	for (n = 0; a[n] && a[n] == b[n]; n++)
+		;
+	return n;
+}
+
+/* Number of bytes in the varint encoding of $v. */
+static size_t _varint_len(size_t v)
+{
+	size_t n;
+	for (n = 1; v >= 0x80; v >>= 7) { n++; }
+	return n;
+}
+
+static char* _varint_put(char *p, size_t v)
+{
+	for (; v >= 0x80; v >>= 7) {
+		*p++ = (char)(v | 0x80);
+	}
+	*p++ = (char)v;
+	return p;
+}
+
+static const char* _varint_get(const char *p, size_t *v)
+{
+	unsigned int shift = 0;
+	*v = 0;
+	do {
+		*v |= (size_t)(*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	return p;
+}
+
+/* Set $s to its first $n bytes, followed by the string at $tail. */
+static int _replace_tail(struct string *s, size_t n, const char *tail)
+{
+	assert(n <= s->len); // LCOV_EXCL_LINE
+
+	s->len = n;
+	s->p   = s->raw + n;
+	*s->p  = '\0';
+	return string_append(s, tail);
+}
+
+/**
+  Make a compact, read-only copy of the sorted stringlist $sl.
+
+  The strings of $sl must be in ascending (`strcmp(3)`) order, as
+  left by @stringlist_sort with `STRINGLIST_SORT_ASC`, and are split
+  up into buckets of $bucket strings each.  The first string of each
+  bucket is stored in full; the rest are stored as the part of each
+  that differs from the string before it.  Lists of paths or keys with
+  long common prefixes shrink to a fraction of their original size.
+
+  Larger buckets save more space, and cost more time in @fclist_get
+  and @fclist_search, which have to decode (on average) half a bucket
+  to find a string.  If $bucket is 0, a default of 16 is used.
+
+  <code>
+  stringlist_sort(paths, STRINGLIST_SORT_ASC);
+  struct fclist *catalog = fclist_new(paths, 0);
+  stringlist_free(paths);
+
+  if (fclist_search(catalog, "/etc/passwd") >= 0) {
+      // ...
+  }
+  </code>
+
+  On success, returns a new front-coded list, which must be freed
+  with @fclist_free.  On failure, returns NULL; if $sl is not sorted,
+  `errno` is set to `EINVAL`.
+ */
+struct fclist* fclist_new(const struct stringlist *sl, size_t bucket)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	struct fclist *fc;
+	size_t i, l, len;
+	char *p;
+
+	if (bucket == 0) { bucket = FCLIST_BUCKET; }
+
+	/* check the order, and size up the encoding, in one pass */
+	for (len = i = 0; i < sl->num; i++) {
+		if (i % bucket == 0) {
+			len += strlen(sl->strings[i]) + 1;
+			if (i > 0 && strcmp(sl->strings[i - 1], sl->strings[i]) > 0) {
+				errno = EINVAL;
+				return NULL;
+			}
+			continue;
+		}
+		l = _lcp(sl->strings[i - 1], sl->strings[i]);
+		if ((unsigned char)sl->strings[i - 1][l] > (unsigned char)sl->strings[i][l]) {
+			errno = EINVAL;
+			return NULL;
+		}
+		len += _varint_len(l) + strlen(sl->strings[i] + l) + 1;
+	}
+
+	if (!(fc = calloc(1, sizeof(struct fclist)))) { return NULL; }
+	fc->num    = sl->num;
+	fc->bucket = bucket;
+	fc->len    = len;
+	fc->heads  = malloc(((sl->num + bucket - 1) / bucket + 1) * sizeof(size_t));
+	fc->data   = malloc(len + 1);
+	if (!fc->heads || !fc->data) {
+		fclist_free(fc);
+		return NULL;
+	}
+
+	for (p = fc->data, i = 0; i < sl->num; i++) {
+		if (i % bucket == 0) {
+			fc->heads[i / bucket] = p - fc->data;
+			l = 0;
+		} else {
+			l = _lcp(sl->strings[i - 1], sl->strings[i]);
+			p = _varint_put(p, l);
+		}
+		len = strlen(sl->strings[i] + l) + 1;
+		memcpy(p, sl->strings[i] + l, len);
+		p += len;
+	}
+
+	return fc;
+}
+
+/**
+  Free the front-coded list $fc.
+ */
+void fclist_free(struct fclist *fc)
+{
+	if (fc) {
+		free(fc->heads);
+		free(fc->data);
+	}
+	free(fc);
+}
+
+/**
+  Get the number of strings in $fc.
+ */
+size_t fclist_len(const struct fclist *fc)
+{
+	assert(fc); // LCOV_EXCL_LINE
+	return fc->num;
+}
+
+/**
+  Get the number of bytes of memory used by $fc.
+ */
+size_t fclist_bytes(const struct fclist *fc)
+{
+	assert(fc); // LCOV_EXCL_LINE
+	return sizeof(struct fclist) + fc->len
+	     + ((fc->num + fc->bucket - 1) / fc->bucket) * sizeof(size_t);
+}
+
+/**
+  Get the next string in $fc.
+
+  The strings of a front-coded list are not stored anywhere in full,
+  so they are decoded into $buf (see @string_new), one at a time.
+  Each one is built from the one before it, so $buf must not be
+  modified between calls.  $c keeps track of where the walk is; it
+  must be zeroed before the first call (@for_each_fcstring does this).
+
+  Returns `$buf->raw`, or NULL once all of $fc has been visited (or,
+  if memory runs out, NULL with `$c->i` less than @fclist_len).
+ */
+const char* fclist_next(const struct fclist *fc, struct fclist_cursor *c, struct string *buf)
+{
+	assert(fc);  // LCOV_EXCL_LINE
+	assert(c);   // LCOV_EXCL_LINE
+	assert(buf); // LCOV_EXCL_LINE
+
+	const char *p;
+	size_t l;
+
+	if (c->i >= fc->num) { return NULL; }
+
+	p = fc->data + c->off;
+	l = 0;
+	if (c->i % fc->bucket != 0) {
+		p = _varint_get(p, &l);
+	}
+	if (_replace_tail(buf, l, p) != 0) {
+		return NULL;
+	}
+
+	c->off = p + strlen(p) + 1 - fc->data;
+	c->i++;
+	return buf->raw;
+}
+
+/**
+  Get the string at position $i of $fc, and store it in $buf.
+
+  This decodes the bucket that the string is in, from the top, up to
+  the string itself.
+
+  On success, returns 0.  On failure (including if $i is out of range),
+  returns non-zero.
+ */
+int fclist_get(const struct fclist *fc, size_t i, struct string *buf)
+{
+	assert(fc);  // LCOV_EXCL_LINE
+	assert(buf); // LCOV_EXCL_LINE
+
+	struct fclist_cursor c;
+
+	if (i >= fc->num) { return -1; }
+
+	c.i   = i - i % fc->bucket;
+	c.off = fc->heads[i / fc->bucket];
+	while (c.i <= i) {
+		if (!fclist_next(fc, &c, buf)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+  Find $s in $fc.
+
+  A binary search over the first string of each bucket finds the
+  only bucket that $s could be in, which is then scanned.  Nothing is
+  decoded along the way; each string in the bucket is compared to $s
+  using only the part of it that is stored, and the length of the
+  prefix that the string before it had in common with $s.
+
+  Returns the position of $s in $fc (the first, if there is more than
+  one), or -1 if it is not there.
+ */
+ssize_t fclist_search(const struct fclist *fc, const char *s)
+{
+	assert(fc); // LCOV_EXCL_LINE
+	assert(s);  // LCOV_EXCL_LINE
+
+	size_t lo, hi, mid, i, end, m, l;
+	const char *p;
+	int cmp;
+
+	/* find the last bucket whose first string is less than $s;
+	   if $s is the first string of a bucket, it might also be
+	   the last string of the bucket before */
+	lo = 0; hi = (fc->num + fc->bucket - 1) / fc->bucket;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(fc->data + fc->heads[mid], s) < 0) { lo = mid + 1; } else { hi = mid; }
+	}
+	if (lo == 0) {
+		return (fc->num && strcmp(fc->data, s) == 0) ? 0 : -1;
+	}
+
+	/* $m is the length of the prefix that $s shares with the
+	   string just visited, which sorts before $s */
+	i   = (lo - 1) * fc->bucket;
+	end = i + fc->bucket < fc->num ? i + fc->bucket : fc->num;
+	p   = fc->data + fc->heads[lo - 1];
+	m   = _lcp(p, s);
+	for (p += strlen(p) + 1, i++; i < end; p += strlen(p) + 1, i++) {
+		p = _varint_get(p, &l);
+		if (l > m) { continue; }  /* same as the last one, up to $s[m] */
+		if (l < m) { return -1; } /* differs from $s earlier, and is greater */
+
+		l = _lcp(p, s + m);
+		cmp = (unsigned char)p[l] - (unsigned char)s[m + l];
+		if (cmp == 0) { return i; }
+		if (cmp > 0)  { return -1; }
+		m += l;
+	}
+
+	/* $s sorts after everything in the bucket; it could only be
+	   the first string of the next one */
+	if (lo < (fc->num + fc->bucket - 1) / fc->bucket
+	 && strcmp(fc->data + fc->heads[lo], s) == 0) {
+		return lo * fc->bucket;
+	}
+	return -1;
+}
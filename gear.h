@@ -28,6 +28,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 /**
   Fast, structure-agnostic doubly-linked circular list.
@@ -54,6 +55,163 @@ struct string {
 	char *p;        /* internal pointer to NULL-terminator of raw */
 };
 
+/**
+  Non-owning String View
+
+  A strview refers to $len bytes starting at $p, inside of a buffer
+  that belongs to someone else.  Views are not NULL-terminated, are
+  passed around by value, and are never freed; they are only valid for
+  as long as the underlying buffer is.
+
+  Views are created with @strview (from a pointer and a length) or
+  @strview_cstr (from a NULL-terminated string), and can be turned back
+  into a dynamically-allocated C string with @strview_dup.
+
+  <code>
+  const char *line = "GET /index.html HTTP/1.1";
+  struct strview method = strview(line, 3);
+
+  if (strview_eq(method, strview_cstr("GET"))) {
+      // ...
+  }
+  </code>
+ */
+struct strview {
+	const char *p;    /* first byte of the view (not NULL-terminated) */
+	size_t      len;  /* length of the view in bytes */
+};
+
+/**
+  Set of Bytes
+
+  A byteset is a set of byte values, for use with @search_set.  It is
+  set up with @byteset_init, and can then be reused for any number of
+  searches.
+ */
+struct byteset {
+	unsigned char map[32];   /* bit (c & 7) of map[c >> 3] is set for each c */
+	unsigned char lo[16];    /* map[2i], for vectorized lookups */
+	unsigned char hi[16];    /* map[2i+1], for vectorized lookups */
+	unsigned char bytes[8];  /* the first 8 members, for small sets */
+	unsigned int  n;         /* number of members */
+};
+
+/** Is byte c a member of byteset set? */
+#define byteset_has(set,c) ((set)->map[(unsigned char)(c) >> 3] & (1 << ((unsigned char)(c) & 7)))
+
+/**
+  Rope (a.k.a. Cord)
+
+  A rope is a string that is stored as a balanced tree of chunks,
+  instead of as one contiguous buffer.  This makes it much cheaper than
+  a variable-length string (see @string_new) to build very large
+  strings out of lots of fragments:
+
+    - @rope_insert adds bytes anywhere without moving any others.
+    - @rope_concat joins two ropes without copying either one.
+    - @rope_substr and @rope_delete take pieces out the same way.
+
+  all in time proportional to the log of the length of the rope.
+
+  The contents of a rope can be visited chunk by chunk, with
+  @rope_next or @for_each_chunk (or handed straight to `writev(2)`
+  via @rope_iov), or flattened into a variable-length string with
+  @rope_string.
+
+  <code>
+  struct rope *doc = rope_new("<html></html>");
+  rope_insert(doc, 6, "<body></body>", 13);
+  rope_insert(doc, 12, "Hello", 5);
+
+  // doc is now "<html><body>Hello</body></html>"
+  rope_free(doc);
+  </code>
+
+  **Note:** ropes created from one another share pieces of memory
+  internally, so they cannot be handed off to different threads
+  without some external locking.
+ */
+struct rope_node;
+struct rope {
+	struct rope_node *root;
+};
+
+#define ROPE_MAX_DEPTH 96
+
+struct rope_cursor {
+	const struct rope_node *stack[ROPE_MAX_DEPTH];
+	int n;
+};
+
+/**
+  String Table, for Interning Strings
+
+  A string table stores exactly one copy of each distinct string
+  interned in it (see @strtab_intern), so that equal strings can be
+  recognized by pointer comparison alone.  Hashes and stringlists can
+  be set up to keep their strings in a string table, via
+  @hash_new_interned and @stringlist_new_interned.
+ */
+struct strtab;
+
+/**
+  Resolver
+
+  A resolver supplies values for the variable references in a
+  template, on demand, for @string_render and @string_render_fd.
+  Resolvers can be chained together via $next; each one is asked
+  in turn until one of them returns a value.
+
+  $resolve is given the name of the reference (which is not
+  NULL-terminated) and the resolver's $udata.  It must return either
+  a dynamically-allocated, NULL-terminated value (which the caller
+  will free), or NULL if it has nothing for that reference.
+
+  Two resolve functions are built in: @RESOLVE_HASH, which looks
+  references up in the `struct hash` given as $udata, and
+  @RESOLVE_ENV, which looks them up in the environment.
+ */
+typedef char* (*resolver_fn)(struct strview ref, void *udata);
+struct resolver {
+	resolver_fn      resolve;
+	void            *udata;
+	struct resolver *next;
+};
+
+/**
+  Replacer
+
+  A replacer is a compiled set of search-and-replace rules, built by
+  @replacer_new from a hash of patterns and their replacements.  It
+  finds every pattern in a single left-to-right pass over its input
+  (an Aho-Corasick automaton), so applying it costs the same no matter
+  how many patterns it was built from.  For a single pattern, see
+  @string_replace_all.
+ */
+struct replacer;
+
+/**
+  Front-Coded List
+
+  A front-coded list is a compact, read-only copy of a sorted
+  stringlist, built by @fclist_new.  Its strings are stored in
+  buckets; the first string of each bucket is stored in full, and each
+  of the others as the length of the prefix it shares with the string
+  before it, followed by the rest of it.  Sorted paths and keys, which
+  share long prefixes, take a fraction of the memory that they would
+  in a stringlist.
+
+  Strings can be visited in order (@fclist_next, @for_each_fcstring),
+  fetched by position (@fclist_get), or found by binary search
+  (@fclist_search).
+ */
+struct fclist;
+
+struct fclist_cursor {
+	size_t i;    /* position of the next string */
+	size_t off;  /* where its encoding starts */
+};
+
 struct hash_cursor {
 	ssize_t l1, l2;
 };
@@ -114,9 +272,15 @@ struct hash_list {
   This enables the implementation to gracefully handle hash
   collisions, where two distinct keys hash to the same
   integral value.
+
+  Normally, a hash keeps its own copy of each key.  A hash created
+  by @hash_new_interned instead interns its keys in a string table,
+  so that lookups by interned strings are decided by comparing
+  pointers, and no key is ever copied more than once.
  */
 struct hash {
 	struct hash_list entries[64];
+	struct strtab *strtab;  /* if set, keys are interned here */
 };
 
 /**
@@ -165,14 +329,50 @@ struct hash {
 
   It is not possible to set up a stringlist allocated on the stack.
  */
+struct sl_block;
+struct sl_index;
+struct sl_map;
 struct stringlist {
 	size_t   num;      /* number of actual strings */
 	size_t   len;      /* number of memory slots for strings */
 	char   **strings;  /* array of NULL-terminated strings */
+
+	struct strtab *strtab; /* if set, strings are interned here */
+
+	unsigned int     flags;
+	struct sl_block *blocks;  /* arena storage (see stringlist_new_arena) */
+	struct sl_index *index;   /* membership index (see stringlist_index) */
+	struct sl_map   *map;     /* file mapping (see stringlist_from_file) */
 };
 
 #define SPLIT_NORMAL  0x00
 #define SPLIT_GREEDY  0x01
+#define SPLIT_STREAM  0x02
+#define SPLIT_COPY    0x04
+#define SPLIT_ARENA   0x08
+
+/**
+  Split Iterator
+
+  A split iterator hands out the tokens of a buffer one at a time
+  (see @split_iter_init and @split_iter_next), as views into that
+  buffer, without building a list or copying anything.
+
+  In `SPLIT_STREAM` mode, the input can arrive in pieces; the last,
+  possibly-incomplete token of each piece is held back until the
+  next one arrives (see @split_iter_refill).  The longest token that
+  can be streamed is the size of the caller's buffer, less the length
+  of the delimiter.
+ */
+struct split_iter {
+	const char *p;          /* start of the unsplit input */
+	const char *end;
+	const char *delim;
+	size_t      delim_len;
+	int         opt;
+
+	const struct byteset *set;  /* if not NULL, split on any of these bytes */
+};
 
 /**
   Callback function signature for sort comparisons.
@@ -183,6 +383,15 @@ struct stringlist {
  */
 typedef int (*sl_comparator)(const void*, const void*);
 
+/**
+  Callback function signature for filtering stringlists.
+
+  An sl_predicate function is passed a string from a stringlist,
+  and the context pointer given to the filtering function (i.e.
+  @stringlist_remove_if), and returns non-zero if the string matches.
+ */
+typedef int (*sl_predicate)(const char*, void*);
+
 struct path {
 	char     *buf;
 	ssize_t   n;
@@ -200,19 +409,55 @@ struct path {
 
 
 char* string(const char *fmt, ...);
+const char* string_scratch(const char *fmt, ...);
 struct string* string_new(const char *str, size_t block);
 void string_free(struct string *s);
 
 int string_append(struct string *s, const char *str);
 int string_append1(struct string *s, char c);
+int string_appendv(struct string *s, struct strview v);
+int string_appendf(struct string *s, const char *fmt, ...);
 int string_interpolate(char *buf, size_t len, const char *src, const struct hash *ctx);
+int string_interpolate_fd(int fd, const char *src, const struct hash *ctx);
+int string_interpolate_FILE(FILE *io, const char *src, const struct hash *ctx);
+int string_render(char *buf, size_t len, const char *src, struct resolver *r);
+int string_render_fd(int fd, const char *src, struct resolver *r);
+char* RESOLVE_HASH(struct strview ref, void *udata);
+char* RESOLVE_ENV(struct strview ref, void *udata);
+struct string* string_replace_all(const char *src, size_t len, const char *find, const char *with);
+
+int strview_cmp(struct strview a, struct strview b);
+int strview_eq(struct strview a, struct strview b);
+unsigned int strview_hash(struct strview v);
+const char* strview_chr(struct strview v, char c);
+const char* strview_find(struct strview hay, struct strview needle);
+char* strview_dup(struct strview v);
+ssize_t strview_split(struct strview *out, size_t max, const char *str, size_t len, const char *delim, int opt);
+
+struct strtab* strtab_new(void);
+void strtab_free(struct strtab *tab);
+const char* strtab_intern(struct strtab *tab, const char *s);
+const char* strtab_internv(struct strtab *tab, struct strview v);
+const char* strtab_lookup(const struct strtab *tab, const char *s);
+const char* strtab_lookupv(const struct strtab *tab, struct strview v);
+size_t intern_len(const char *s);
+unsigned int intern_hash(const char *s);
+
+void byteset_init(struct byteset *set, const char *bytes, size_t n);
+const char* search_byte(const char *s, size_t n, char c);
+const char* search_set(const char *s, size_t n, const struct byteset *set);
+const char* search_str(const char *hay, size_t n, const char *needle, size_t m);
 
 unsigned char H64(const char *s);
 struct hash *hash_new(void);
+struct hash *hash_new_interned(struct strtab *tab);
 void hash_free(struct hash *h);
 void hash_free_all(struct hash *h);
 void* hash_get(const struct hash *h, const char *k);
+void* hash_get_interned(const struct hash *h, const char *k);
 void* hash_set(struct hash *h, const char *k, void *v);
+void* hash_getv(const struct hash *h, struct strview k);
+void* hash_setv(struct hash *h, struct strview k, void *v);
 void *hash_next(const struct hash *h, struct hash_cursor *c, char **key, void **val);
 
 /**
@@ -244,6 +489,61 @@ void *hash_next(const struct hash *h, struct hash_cursor *c, char **key, void **
 	for ((cursor)->l1 = 0, (cursor)->l2 = -1; \
 	     hash_next((hash), (cursor), &(key), (void**)&(val)); )
 
+struct rope* rope_new(const char *str);
+void rope_free(struct rope *r);
+size_t rope_len(const struct rope *r);
+int rope_append(struct rope *r, const char *str, size_t len);
+int rope_insert(struct rope *r, size_t pos, const char *str, size_t len);
+int rope_concat(struct rope *dst, const struct rope *src);
+int rope_delete(struct rope *r, size_t pos, size_t len);
+struct rope* rope_substr(const struct rope *r, size_t pos, size_t len);
+const char* rope_next(const struct rope *r, struct rope_cursor *c, size_t *len);
+size_t rope_iov(const struct rope *r, struct rope_cursor *c, struct iovec *iov, size_t n);
+struct string* rope_string(const struct rope *r);
+
+struct replacer* replacer_new(const struct hash *patterns);
+void replacer_free(struct replacer *r);
+struct string* replacer_apply(const struct replacer *r, const char *src, size_t len);
+
+struct fclist* fclist_new(const struct stringlist *sl, size_t bucket);
+void fclist_free(struct fclist *fc);
+size_t fclist_len(const struct fclist *fc);
+size_t fclist_bytes(const struct fclist *fc);
+const char* fclist_next(const struct fclist *fc, struct fclist_cursor *c, struct string *buf);
+int fclist_get(const struct fclist *fc, size_t i, struct string *buf);
+ssize_t fclist_search(const struct fclist *fc, const char *s);
+
+/**
+  Iterate over the strings of front-coded list $fc
+
+  Each time through the loop, $s points to the next string of $fc,
+  which has been decoded into the variable-length string $buf.
+  See @fclist_next.
+
+  <code>
+  struct fclist_cursor c;
+  struct string *buf = string_new(NULL, 0);
+  const char *s;
+
+  for_each_fcstring(catalog, &c, buf, s) {
+      printf("%s\n", s);
+  }
+  string_free(buf);
+  </code>
+ */
+#define for_each_fcstring(fc, cursor, buf, s) \
+	for ((cursor)->i = (cursor)->off = 0; ((s) = fclist_next((fc), (cursor), (buf))) != NULL; )
+
+/**
+  Iterate over the chunks of rope $r
+
+  This works like @for_each_key_value, but for ropes; each time
+  through the loop, $p points to the next chunk of $r, and $len is
+  set to its length.  See @rope_next.
+ */
+#define for_each_chunk(r, cursor, p, len) \
+	for ((cursor)->n = -1; ((p) = rope_next((r), (cursor), &(len))) != NULL; )
+
 char* pack(const char *prefix, const char *format, ...);
 int unpack(const char *packed, const char *prefix, const char *format, ...);
 
@@ -253,21 +553,50 @@ int STRINGLIST_SORT_ASC(const void *a, const void *b);
 int STRINGLIST_SORT_DESC(const void *a, const void *b);
 
 struct stringlist* stringlist_new(char** src);
+struct stringlist* stringlist_new_interned(char **src, struct strtab *tab);
+struct stringlist* stringlist_new_arena(char **src);
 struct stringlist* stringlist_dup(struct stringlist *orig);
 void stringlist_free(struct stringlist *list);
 void stringlist_sort(struct stringlist *list, sl_comparator cmp);
+int stringlist_sort_parallel(struct stringlist *list, sl_comparator cmp, int nthreads);
 void stringlist_uniq(struct stringlist *list);
+int stringlist_dedup(struct stringlist *list);
 int stringlist_search(const struct stringlist *list, const char *needle);
+int stringlist_index(struct stringlist *list);
+void stringlist_unindex(struct stringlist *list);
 int stringlist_add(struct stringlist *list, const char *value);
+int stringlist_addv(struct stringlist *list, struct strview value);
+int stringlist_reserve(struct stringlist *list, size_t n);
+int stringlist_add_n(struct stringlist *list, char **strs, size_t n);
 int stringlist_add_all(struct stringlist *dst, const struct stringlist *src);
+int stringlist_adopt(struct stringlist *list, char *value);
+int stringlist_adopt_n(struct stringlist *list, char **strs, size_t n);
 int stringlist_remove(struct stringlist *list, const char *value);
+char* stringlist_take(struct stringlist *list, size_t i);
+size_t stringlist_remove_if(struct stringlist *list, sl_predicate pred, void *ctx);
+size_t stringlist_retain_if(struct stringlist *list, sl_predicate pred, void *ctx);
 int stringlist_remove_all(struct stringlist *dst, struct stringlist *src);
 struct stringlist* stringlist_intersect(const struct stringlist *a, const struct stringlist *b);
+struct stringlist* stringlist_union(const struct stringlist *a, const struct stringlist *b);
+struct stringlist* stringlist_subtract(const struct stringlist *a, const struct stringlist *b);
+struct stringlist* stringlist_merge(struct stringlist **lists, size_t n, int uniq);
 int stringlist_diff(struct stringlist *a, struct stringlist *b);
 char* stringlist_join(struct stringlist *list, const char *delim);
+int stringlist_join_into(struct string *dst, const struct stringlist *list, const char *delim);
+int stringlist_join_fd(int fd, const struct stringlist *list, const char *delim);
 struct stringlist* stringlist_split(const char *str, size_t len, const char *delim, int opt);
+struct stringlist* stringlist_split_parallel(const char *str, size_t len, const char *delim, int opt, int nthreads);
+struct stringlist* stringlist_split_set(const char *str, size_t len, const struct byteset *set, int opt);
+struct stringlist* stringlist_from_file(const char *path, const char *delim, int opt);
+
+void split_iter_init(struct split_iter *it, const char *str, size_t len, const char *delim, int opt);
+void split_iter_init_set(struct split_iter *it, const char *str, size_t len, const struct byteset *set, int opt);
+int split_iter_next(struct split_iter *it, struct strview *tok);
+struct strview split_iter_tail(const struct split_iter *it);
+void split_iter_refill(struct split_iter *it, const char *str, size_t len, int more);
 
 struct path* path_new(const char *path);
+struct path* path_newv(struct strview path);
 void path_free(struct path *path);
 const char *path(struct path *path);
 int path_canon(struct path *path);
@@ -286,6 +615,19 @@ void NOTICE(const char *format, ...);
 void INFO(const char *format, ...);
 void DEBUG(const char *format, ...);
 
+/** Make a view of the $len bytes at $p */
+static inline struct strview strview(const char *p, size_t len)
+{
+	struct strview v = { p, len };
+	return v;
+}
+
+/** Make a view of the NULL-terminated string $s */
+static inline struct strview strview_cstr(const char *s)
+{
+	return strview(s, s ? strlen(s) : 0);
+}
+
 /** Declare / initialize an empty list */
 #define LIST(n) struct list n = { &(n), &(n) }
 
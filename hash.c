@@ -69,6 +69,28 @@ struct hash *hash_new(void)
 	return calloc(1, sizeof(struct hash));
 }
 
+/**
+  Create a new, empty hash, with keys interned in $tab.
+
+  Instead of storing a copy of each key, the hash stores the canonical
+  copy from @strtab_intern.  Setting a value under a key that has already
+  been interned doesn't allocate anything.  Keys are bucketed by the hash
+  cached in the table, and matched by pointer; other strings are looked
+  up in $tab first, so @hash_get costs one hash and one string compare,
+  and @hash_get_interned (given an interned key) costs neither.
+
+  Keys belong to $tab, and it must outlive the hash.
+
+  On success, returns a pointer to the hash.
+  On failure, returns NULL.
+ */
+struct hash *hash_new_interned(struct strtab *tab)
+{
+	struct hash *h = hash_new();
+	if (h) { h->strtab = tab; }
+	return h;
+}
+
 /**
   Free hash $h.
 
@@ -81,7 +103,7 @@ void hash_free(struct hash *h)
 {
 	ssize_t i, j;
 	for (i = 0; i < 64; i++) {
-		for (j = 0; j < h->entries[i].len; j++) {
+		for (j = 0; !h->strtab && j < h->entries[i].len; j++) {
 			free(h->entries[i].keys[j]);
 		}
 		free(h->entries[i].keys);
@@ -102,7 +124,7 @@ void hash_free_all(struct hash *h)
 	ssize_t i, j;
 	for (i = 0; i < 64; i++) {
 		for (j = 0; j < h->entries[i].len; j++) {
-			free(h->entries[i].keys[j]);
+			if (!h->strtab) { free(h->entries[i].keys[j]); }
 			free(h->entries[i].values[j]);
 		}
 		free(h->entries[i].keys);
@@ -115,14 +137,43 @@ static ssize_t get_index(const struct hash_list *hl, const char *k)
 {
 	ssize_t i;
 	for (i = 0; i < hl->len; i++) {
-		if (strcmp(hl->keys[i], k) == 0) {
+		if (hl->keys[i] == k || strcmp(hl->keys[i], k) == 0) {
+			return i;
+		}
+	}
+	return (ssize_t)-1;
+}
+
+/* $k must be the canonical (interned) copy; so are all the keys */
+static ssize_t get_interned(const struct hash_list *hl, const char *k)
+{
+	ssize_t i;
+	for (i = 0; i < hl->len; i++) {
+		if (hl->keys[i] == k) {
+			return i;
+		}
+	}
+	return (ssize_t)-1;
+}
+
+/* bucket for interned key $k, from the hash cached by the strtab
+   (the same djb2 value that H64 and strview_hash calculate) */
+#define HI(k) (intern_hash(k) & 0x3f)
+
+static ssize_t get_indexv(const struct hash_list *hl, struct strview k)
+{
+	ssize_t i;
+	for (i = 0; i < hl->len; i++) {
+		/* $k may hold NULs, so don't read past the end of keys[i] */
+		if (strlen(hl->keys[i]) == k.len && memcmp(hl->keys[i], k.p, k.len) == 0) {
 			return i;
 		}
 	}
 	return (ssize_t)-1;
 }
 
-static int insert(struct hash_list *hl, const char *k, void *v)
+/* takes ownership of $k */
+static int insert(struct hash_list *hl, char *k, void *v)
 {
 	char **new_k;
 	void **new_v;
@@ -131,7 +182,7 @@ static int insert(struct hash_list *hl, const char *k, void *v)
 	new_v = realloc(hl->values, (hl->len + 1) * sizeof(void*));
 
 	/* FIXME check new_k / new_v for NULL */
-	new_k[hl->len] = strdup(k);
+	new_k[hl->len] = k;
 	new_v[hl->len] = v;
 
 	hl->keys   = new_k;
@@ -141,6 +192,27 @@ static int insert(struct hash_list *hl, const char *k, void *v)
 	return 0;
 }
 
+/* store $v under the interned key $k (NULL if interning failed) */
+static void* set_interned(struct hash *h, const char *k, void *v)
+{
+	ssize_t i;
+	void *existing;
+	struct hash_list *hl;
+
+	if (!k) { return NULL; }
+
+	hl = &h->entries[HI(k)];
+	i = get_interned(hl, k);
+
+	if (i < 0) {
+		insert(hl, (char*)k, v);
+		return v;
+	}
+	existing = hl->values[i];
+	hl->values[i] = v;
+	return existing;
+}
+
 /**
   Get the value from $h for $k.
 
@@ -158,11 +230,39 @@ void* hash_get(const struct hash *h, const char *k)
 
 	if (!h || !k) { return NULL; }
 
+	if (h->strtab) {
+		return hash_get_interned(h, strtab_lookup(h->strtab, k));
+	}
+
 	hl = &h->entries[H64(k)];
 	i = get_index(hl, k);
 	return (i < 0 ? NULL : hl->values[i]);
 }
 
+/**
+  Get the value from $h for the interned key $k.
+
+  $h must have been created by @hash_new_interned, and $k must have
+  been returned by @strtab_intern (or @strtab_internv) for the same
+  table.  Since both sides are interned, the key's cached hash picks
+  the bucket, and keys are matched by pointer alone; no strings are
+  hashed or compared.
+
+  If found, returns the value.  Otherwise, returns NULL.
+ */
+void* hash_get_interned(const struct hash *h, const char *k)
+{
+	ssize_t i;
+	const struct hash_list *hl;
+
+	if (!h || !k) { return NULL; }
+	assert(h->strtab); // LCOV_EXCL_LINE
+
+	hl = &h->entries[HI(k)];
+	i = get_interned(hl, k);
+	return (i < 0 ? NULL : hl->values[i]);
+}
+
 /**
   Store $v in $h, under key $k.
 
@@ -181,11 +281,15 @@ void* hash_set(struct hash *h, const char *k, void *v)
 
 	if (!h || !k) { return NULL; }
 
+	if (h->strtab) {
+		return set_interned(h, strtab_intern(h->strtab, k), v);
+	}
+
 	hl = &h->entries[H64(k)];
 	i = get_index(hl, k);
 
 	if (i < 0) {
-		insert(hl, k, v);
+		insert(hl, strdup(k), v);
 		return v;
 	} else {
 		existing = hl->values[i];
@@ -237,3 +341,61 @@ void *hash_next(const struct hash *h, struct hash_cursor *c, char **key, void **
 	return *key;
 }
 
+
+/**
+  Get the value from $h for the key viewed by $k.
+
+  This works just like @hash_get, except that the key does not need
+  to be NULL-terminated, so it can be looked up in place, straight
+  out of a larger buffer.
+
+  If found, returns the value.  Otherwise, returns NULL.
+ */
+void* hash_getv(const struct hash *h, struct strview k)
+{
+	ssize_t i;
+	const struct hash_list *hl;
+
+	if (!h || !k.p) { return NULL; }
+
+	if (h->strtab) {
+		return hash_get_interned(h, strtab_lookupv(h->strtab, k));
+	}
+
+	hl = &h->entries[strview_hash(k) & 0x3f];
+	i = get_indexv(hl, k);
+	return (i < 0 ? NULL : hl->values[i]);
+}
+
+/**
+  Store $v in $h, under the key viewed by $k.
+
+  This works just like @hash_set; if $k is not already in $h, a
+  NULL-terminated copy of it is made for the hash to keep.
+
+  On success, returns $v.  On failure, returns NULL.
+ */
+void* hash_setv(struct hash *h, struct strview k, void *v)
+{
+	ssize_t i;
+	void *existing;
+	struct hash_list *hl;
+
+	if (!h || !k.p) { return NULL; }
+
+	if (h->strtab) {
+		return set_interned(h, strtab_internv(h->strtab, k), v);
+	}
+
+	hl = &h->entries[strview_hash(k) & 0x3f];
+	i = get_indexv(hl, k);
+
+	if (i < 0) {
+		insert(hl, strview_dup(k), v);
+		return v;
+	} else {
+		existing = hl->values[i];
+		hl->values[i] = v;
+		return existing;
+	}
+}
@@ -55,25 +55,16 @@ static char* _escape(const char *string)
 	return escaped;
 }
 
-static char* _unescape(const char *string)
+static char* _unescape(struct strview v)
 {
 	char *unescaped, *write_ptr;
-	const char *read_ptr;
-	size_t len;
+	const char *read_ptr, *end = v.p + v.len;
 	char last = '\0';
 
-	for (len = 0, read_ptr = string; *read_ptr; read_ptr++) {
-		len++;
-		if (*read_ptr == '"' && last == '\\') {
-			len--;
-		}
-		last = *read_ptr;
-	}
-
-	last = '\0';
-	unescaped = calloc(len + 1, sizeof(char));
+	/* unescaping never makes the string any longer */
+	unescaped = calloc(v.len + 1, sizeof(char));
 	if (!unescaped) { return NULL; }
-	for (write_ptr = unescaped, read_ptr = string; *read_ptr; read_ptr++) {
+	for (write_ptr = unescaped, read_ptr = v.p; read_ptr != end; read_ptr++) {
 		if (last == '\\') {
 			if (*read_ptr == '"') {
 				*write_ptr++ = '"';
@@ -276,9 +267,9 @@ char* pack(const char *prefix, const char *format, ...)
 	return dst;
 }
 
-static char* _extract_string(const char *start)
+static struct strview _extract_string(const char *start)
 {
-	char last, *buf;
+	char last;
 	const char *a, *b;
 
 	for (a = start; *a && *a++ != '"'; )
@@ -286,12 +277,7 @@ static char* _extract_string(const char *start)
 	for (last = '\0', b = a; *b && !(last != '\\' && *b == '"'); last = *b, b++)
 		;
 
-	buf = calloc(b - a + 1, sizeof(char));
-	if (!buf) { return NULL; }
-	memcpy(buf, a, b - a);
-	buf[b-a] = '\0';
-
-	return buf;
+	return strview(a, b - a);
 }
 
 /**
@@ -312,7 +298,7 @@ int unpack(const char *packed, const char *prefix, const char *format, ...)
 	va_list args;
 
 	/* for string extraction */
-	char *escaped, *unescaped;
+	struct strview escaped;
 	size_t l;
 
 	l = strlen(prefix);
@@ -324,12 +310,9 @@ int unpack(const char *packed, const char *prefix, const char *format, ...)
 		switch (*format++) {
 		case 'a': /* NULL-terminated character string */
 			escaped = _extract_string(packed);
-			packed += strlen(escaped) + 2; /* +2 for quotes */
-
-			unescaped = _unescape(escaped);
-			free(escaped);
+			packed += escaped.len + 2; /* +2 for quotes */
 
-			*(va_arg(args, char **)) = unescaped;
+			*(va_arg(args, char **)) = _unescape(escaped);
 			break;
 		case 'c': /* signed char    (8-bit) */
 			memcpy(hex, packed, 2);
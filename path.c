@@ -21,20 +21,26 @@
 
 struct path* path_new(const char *s)
 {
-	struct path *p;
 	if (!s) { return NULL; }
+	return path_newv(strview_cstr(s));
+}
+
+struct path* path_newv(struct strview s)
+{
+	struct path *p;
+	if (!s.p) { return NULL; }
 
 	p = calloc(1, sizeof(struct path));
 	if (!p) { return NULL; }
 
-	p->n = p->len = strlen(s);
+	p->n = p->len = s.len;
 	p->buf = calloc(p->len+2, sizeof(char));
 	if (!p->buf) {
 		free(p);
 		return NULL;
 	}
 
-	memcpy(p->buf, s, p->len);
+	memcpy(p->buf, s.p, p->len);
 	return p;
 }
 
@@ -0,0 +1,272 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "gear.h"
+
+/* One state of the matching automaton; each state stands for
+   the $depth-byte prefix of one or more patterns. */
+struct _acstate {
+	size_t depth;   /* length of the prefix this state represents */
+	size_t mlen;    /* length of the longest pattern ending here */
+	int    match;   /* index of that pattern, or -1 */
+};
+
+struct replacer {
+	unsigned char    cls[256]; /* byte -> column in $delta */
+	unsigned int     ncls;     /* number of columns in $delta */
+	unsigned int     nstates;
+	int             *delta;    /* nstates x ncls transition table */
+	struct _acstate *states;
+	struct strview  *with;     /* replacement, by pattern index */
+	char            *pool;     /* storage for the replacements */
+};
+
+#define _next(r,s,c) ((r)->delta[(size_t)(s) * (r)->ncls + (r)->cls[(unsigned char)(c)]])
+
+/* Turn the trie in $r->delta into a full DFA, breadth-first,
+   by filling in every missing transition from the failure state. */
+static int _compile(struct replacer *r)
+{
+	unsigned int *queue, *fail, head, tail, s, t, c;
+
+	queue = calloc(r->nstates, sizeof(unsigned int));
+	fail  = calloc(r->nstates, sizeof(unsigned int));
+	if (!queue || !fail) {
+		free(queue);
+		free(fail);
+		return -1;
+	}
+
+	head = tail = 0;
+	for (c = 0; c < r->ncls; c++) {
+		if ((t = r->delta[c]) != 0) {
+			fail[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+
+	while (head < tail) {
+		s = queue[head++];
+		if (r->states[s].match < 0) {
+			r->states[s].match = r->states[fail[s]].match;
+			r->states[s].mlen  = r->states[fail[s]].mlen;
+		}
+
+		for (c = 0; c < r->ncls; c++) {
+			t = r->delta[s * r->ncls + c];
+			if (t) {
+				fail[t] = r->delta[fail[s] * r->ncls + c];
+				queue[tail++] = t;
+			} else {
+				r->delta[s * r->ncls + c] = r->delta[fail[s] * r->ncls + c];
+			}
+		}
+	}
+
+	free(queue);
+	free(fail);
+	return 0;
+}
+
+/**
+  Compile a multi-pattern replacer from $patterns.
+
+  Each key of the $patterns hash is a string to search for, and its
+  value is the (NULL-terminated) string to replace it with.  A NULL
+  value replaces matches with nothing.  The patterns and replacements
+  are copied, so $patterns can be freed as soon as this returns.
+
+  The returned replacer can then be applied, with @replacer_apply,
+  to any number of inputs (from any number of threads), until it is
+  freed with @replacer_free.
+
+  Returns a new replacer on success, or NULL on failure, or if
+  $patterns has no keys, or if any of them is the empty string.
+ */
+struct replacer* replacer_new(const struct hash *patterns)
+{
+	struct replacer *r;
+	struct hash_cursor cur;
+	char *k, *v, *p;
+	size_t total, pool, npat, i;
+	unsigned int s, t;
+	int idx;
+
+	assert(patterns); // LCOV_EXCL_LINE
+
+	total = pool = npat = 0;
+	r = calloc(1, sizeof(struct replacer));
+	if (!r) { return NULL; }
+
+	for_each_key_value(patterns, &cur, k, v) {
+		if (!*k) { goto failed; }
+		total += strlen(k);
+		pool  += (v ? strlen(v) : 0) + 1;
+		npat++;
+		for (p = k; *p; p++) {
+			r->cls[(unsigned char)*p] = 1;
+		}
+	}
+	if (npat == 0) { goto failed; }
+
+	/* bytes that appear in no pattern all share column 0 */
+	r->ncls = 1;
+	for (i = 0; i < 256; i++) {
+		if (r->cls[i]) { r->cls[i] = r->ncls++; }
+	}
+
+	r->delta  = calloc((total + 1) * r->ncls, sizeof(int));
+	r->states = calloc(total + 1, sizeof(struct _acstate));
+	r->with   = calloc(npat, sizeof(struct strview));
+	r->pool   = malloc(pool);
+	if (!r->delta || !r->states || !r->with || !r->pool) { goto failed; }
+
+	r->nstates = 1;
+	r->states[0].match = -1;
+
+	p = r->pool; idx = 0;
+	for_each_key_value(patterns, &cur, k, v) {
+		for (s = 0; *k; k++, s = t) {
+			t = _next(r, s, *k);
+			if (!t) {
+				t = r->nstates++;
+				r->states[t].depth = r->states[s].depth + 1;
+				r->states[t].match = -1;
+				_next(r, s, *k) = t;
+			}
+		}
+		r->states[s].match = idx;
+		r->states[s].mlen  = r->states[s].depth;
+
+		i = v ? strlen(v) : 0;
+		memcpy(p, v ? v : "", i + 1);
+		r->with[idx++] = strview(p, i);
+		p += i + 1;
+	}
+
+	if (_compile(r) != 0) { goto failed; }
+	return r;
+
+failed:
+	replacer_free(r);
+	return NULL;
+}
+
+/**
+  Free a replacer, created by @replacer_new.
+ */
+void replacer_free(struct replacer *r)
+{
+	if (r) {
+		free(r->delta);
+		free(r->states);
+		free(r->with);
+		free(r->pool);
+	}
+	free(r);
+}
+
+/**
+  Replace every occurrence of $r's patterns in the $len bytes at $src.
+
+  The input is scanned left to right, through an automaton that
+  tracks every pattern at once.  Where two patterns overlap, the one
+  that starts first wins, and of those that start at the same place,
+  the longest wins; scanning then picks up again right after the
+  replaced text, so replacements are never themselves searched for
+  patterns.
+
+  Finding the longest match can mean reading past the end of a
+  shorter one, and those bytes are read again when scanning restarts
+  after it.  Each byte is read once between matches, but up to (the
+  length of the longest pattern) times in all, in the worst case.
+
+  <code>
+  struct hash *h = hash_new();
+  hash_set(h, "cat",  "dog");
+  hash_set(h, "catalog", "list");
+
+  struct replacer *r = replacer_new(h);
+  struct string *s = replacer_apply(r, "a cat catalog", 13);
+  // s->raw is now "a dog list"
+  </code>
+
+  Returns a new variable-length string holding the result,
+  or NULL on failure.
+ */
+struct string* replacer_apply(const struct replacer *r, const char *src, size_t len)
+{
+	struct string *out;
+	size_t i, pos, ms, me;
+	unsigned int s;
+	int have, mp;
+
+	assert(r); // LCOV_EXCL_LINE
+
+	out = string_new(NULL, len + 1);
+	if (!out) { return NULL; }
+
+	pos = i = ms = me = 0;
+	s = 0; have = 0; mp = -1;
+	for (;;) {
+		if (i < len) {
+			s = _next(r, s, src[i++]);
+			if (r->states[s].match >= 0
+			 && (!have || i - r->states[s].mlen < ms)) {
+				/* leftmost so far; matches that end later but start in
+				   the same place are longer, and replace this one below */
+				have = 1;
+				mp = r->states[s].match;
+				ms = i - r->states[s].mlen;
+				me = i;
+
+			} else if (have && r->states[s].match >= 0
+			        && i - r->states[s].mlen == ms) {
+				mp = r->states[s].match;
+				me = i;
+			}
+
+			/* keep going while a longer or earlier match is still possible */
+			if (!have || i - r->states[s].depth <= ms) {
+				continue;
+			}
+
+		} else if (!have) {
+			break;
+		}
+
+		if (string_appendv(out, strview(src + pos, ms - pos)) != 0
+		 || string_appendv(out, r->with[mp]) != 0) {
+			string_free(out);
+			return NULL;
+		}
+		/* rescan whatever was read past the match, from scratch */
+		pos = i = me;
+		s = 0; have = 0;
+	}
+
+	if (string_appendv(out, strview(src + pos, len - pos)) != 0) {
+		string_free(out);
+		return NULL;
+	}
+	return out;
+}
@@ -0,0 +1,491 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gear.h"
+
+/* leaves never hold more than this many bytes */
+#define ROPE_LEAF_MAX 1024
+
+/*
+  Ropes are AVL trees of immutable, reference-counted nodes.  Since a
+  node is never changed once it has been built, subtrees can be shared
+  freely between ropes (and between the old and new versions of the
+  same rope), which is what keeps concatenation and substrings cheap.
+ */
+struct rope_node {
+	struct rope_node *left;   /* NULL for leaves */
+	struct rope_node *right;  /* NULL for leaves */
+	size_t            len;    /* number of bytes under this node */
+	unsigned int      depth;  /* height of the subtree; 0 for leaves */
+	unsigned int      refs;   /* number of parents / ropes pointing here */
+	char              data[]; /* leaf contents (not NULL-terminated) */
+};
+
+static inline unsigned int _h(const struct rope_node *t)
+{
+	return t ? t->depth : 0;
+}
+
+static inline struct rope_node* _ref(struct rope_node *t)
+{
+	if (t) { t->refs++; }
+	return t;
+}
+
+static void _unref(struct rope_node *t)
+{
+	if (t && --t->refs == 0) {
+		_unref(t->left);
+		_unref(t->right);
+		free(t);
+	}
+}
+
+static struct rope_node* _leaf(const char *s, size_t n)
+{
+	struct rope_node *t = malloc(sizeof(struct rope_node) + n);
+	if (!t) { return NULL; }
+
+	t->left = t->right = NULL;
+	t->len   = n;
+	t->depth = 0;
+	t->refs  = 1;
+	memcpy(t->data, s, n);
+	return t;
+}
+
+/*
+  Build an interior node over $l and $r, taking over the caller's
+  references to both.  If either side is missing (because an earlier
+  allocation failed) the whole thing is dropped; the callers notice
+  the short length and back out.
+ */
+static struct rope_node* _node(struct rope_node *l, struct rope_node *r)
+{
+	struct rope_node *t;
+
+	if (!l || !r || !(t = malloc(sizeof(struct rope_node)))) {
+		_unref(l);
+		_unref(r);
+		return NULL;
+	}
+
+	t->left  = l;
+	t->right = r;
+	t->len   = l->len + r->len;
+	t->depth = 1 + (l->depth > r->depth ? l->depth : r->depth);
+	t->refs  = 1;
+	return t;
+}
+
+/* like _node, but rotates (copying, not modifying) to stay balanced */
+static struct rope_node* _balance(struct rope_node *l, struct rope_node *r)
+{
+	struct rope_node *t;
+
+	if (l && _h(l) > _h(r) + 1) {
+		if (_h(l->left) >= _h(l->right)) {
+			t = _node(_ref(l->left), _node(_ref(l->right), r));
+		} else {
+			t = _node(_node(_ref(l->left), _ref(l->right->left)),
+			          _node(_ref(l->right->right), r));
+		}
+		_unref(l);
+		return t;
+	}
+
+	if (r && _h(r) > _h(l) + 1) {
+		if (_h(r->right) >= _h(r->left)) {
+			t = _node(_node(l, _ref(r->left)), _ref(r->right));
+		} else {
+			t = _node(_node(l, _ref(r->left->left)),
+			          _node(_ref(r->left->right), _ref(r->right)));
+		}
+		_unref(r);
+		return t;
+	}
+
+	return _node(l, r);
+}
+
+/* concatenate $l and $r, taking over the caller's references */
+static struct rope_node* _join(struct rope_node *l, struct rope_node *r)
+{
+	struct rope_node *t;
+
+	if (!l) { return r; }
+	if (!r) { return l; }
+
+	if (!l->depth && !r->depth && l->len + r->len <= ROPE_LEAF_MAX) {
+		if ((t = malloc(sizeof(struct rope_node) + l->len + r->len)) != NULL) {
+			t->left = t->right = NULL;
+			t->len   = l->len + r->len;
+			t->depth = 0;
+			t->refs  = 1;
+			memcpy(t->data, l->data, l->len);
+			memcpy(t->data + l->len, r->data, r->len);
+		}
+		_unref(l);
+		_unref(r);
+		return t;
+	}
+
+	/* descend the taller side until the heights match up, so that
+	   the work done is proportional to the difference in height. */
+	if (l->depth > r->depth + 1
+	 || (!r->depth && l->depth && !l->right->depth && l->right->len + r->len <= ROPE_LEAF_MAX)) {
+		t = _balance(_ref(l->left), _join(_ref(l->right), r));
+		_unref(l);
+		return t;
+	}
+	if (r->depth > l->depth + 1
+	 || (!l->depth && r->depth && !r->left->depth && l->len + r->left->len <= ROPE_LEAF_MAX)) {
+		t = _balance(_join(l, _ref(r->left)), _ref(r->right));
+		_unref(r);
+		return t;
+	}
+
+	return _node(l, r);
+}
+
+/* split $t into new references to its first $pos bytes and the rest */
+static void _split(struct rope_node *t, size_t pos, struct rope_node **l, struct rope_node **r)
+{
+	struct rope_node *m;
+
+	if (!t || pos == 0) {
+		*l = NULL;
+		*r = _ref(t);
+
+	} else if (pos >= t->len) {
+		*l = _ref(t);
+		*r = NULL;
+
+	} else if (!t->depth) {
+		*l = _leaf(t->data, pos);
+		*r = _leaf(t->data + pos, t->len - pos);
+
+	} else if (pos <= t->left->len) {
+		_split(t->left, pos, l, &m);
+		*r = _join(m, _ref(t->right));
+
+	} else {
+		_split(t->right, pos - t->left->len, &m, r);
+		*l = _join(_ref(t->left), m);
+	}
+}
+
+/* build a balanced tree of full leaves holding a copy of $s */
+static struct rope_node* _build(const char *s, size_t n)
+{
+	size_t half;
+
+	if (n == 0) { return NULL; }
+	if (n <= ROPE_LEAF_MAX) { return _leaf(s, n); }
+
+	half = ((n / ROPE_LEAF_MAX + 1) / 2) * ROPE_LEAF_MAX;
+	return _node(_build(s, half), _build(s + half, n - half));
+}
+
+/* make $t the new contents of $r, unless it came up short */
+static int _commit(struct rope *r, struct rope_node *t, size_t len)
+{
+	if ((t ? t->len : 0) != len) {
+		_unref(t);
+		return -1;
+	}
+
+	_unref(r->root);
+	r->root = t;
+	return 0;
+}
+
+/************************************************************************/
+
+/**
+  Create a new rope.
+
+  If $str is not NULL, the new rope will contain a copy of it.
+
+  **Note:** The pointer returned by this function must be passed to
+  @rope_free in order to reclaim the memory it uses.
+
+  On success, returns a pointer to the new rope.
+  On failure, returns NULL.
+ */
+struct rope* rope_new(const char *str)
+{
+	struct rope *r = calloc(1, sizeof(struct rope));
+	if (!r) { return NULL; }
+
+	if (str && rope_append(r, str, strlen(str)) != 0) {
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+/**
+  Free rope $r.
+
+  Pieces of $r that are shared with other ropes (via @rope_concat
+  or @rope_substr) are left alone until the last rope using them
+  is freed.
+ */
+void rope_free(struct rope *r)
+{
+	if (r) { _unref(r->root); }
+	free(r);
+}
+
+/**
+  Get the length of $r, in bytes.
+ */
+size_t rope_len(const struct rope *r)
+{
+	return r->root ? r->root->len : 0;
+}
+
+/**
+  Append a copy of the $len bytes at $str to the end of $r.
+
+  Appending small fragments one after another fills up the last
+  leaf of the rope before a new one is started, so repeated appends
+  do not degrade into a long list of tiny pieces.
+
+  On success, returns 0.  On failure, returns non-zero and $r is
+  left unmodified.
+ */
+int rope_append(struct rope *r, const char *str, size_t len)
+{
+	assert(r); // LCOV_EXCL_LINE
+
+	return rope_insert(r, rope_len(r), str, len);
+}
+
+/**
+  Insert a copy of the $len bytes at $str into $r, at offset $pos.
+
+  Insertion takes time proportional to the log of the length of
+  $r (plus the time to copy $str); none of the existing contents of
+  $r are moved.
+
+  On success, returns 0.  On failure (including when $pos is past
+  the end of $r), returns non-zero and $r is left unmodified.
+ */
+int rope_insert(struct rope *r, size_t pos, const char *str, size_t len)
+{
+	assert(r); // LCOV_EXCL_LINE
+
+	struct rope_node *a, *b;
+	size_t total = rope_len(r);
+
+	if (pos > total) { return -1; }
+	if (len == 0) { return 0; }
+
+	_split(r->root, pos, &a, &b);
+	return _commit(r, _join(_join(a, _build(str, len)), b), total + len);
+}
+
+/**
+  Append the contents of $src to the end of $dst.
+
+  The two ropes end up sharing all of the pieces of $src, so nothing
+  is copied and the concatenation takes time proportional to the log
+  of their lengths.  $src is not modified, and must still be freed
+  separately.
+
+  On success, returns 0.  On failure, returns non-zero and $dst is
+  left unmodified.
+ */
+int rope_concat(struct rope *dst, const struct rope *src)
+{
+	assert(dst); // LCOV_EXCL_LINE
+	assert(src); // LCOV_EXCL_LINE
+
+	size_t total = rope_len(dst) + rope_len(src);
+	return _commit(dst, _join(_ref(dst->root), _ref(src->root)), total);
+}
+
+/**
+  Remove $len bytes from $r, starting at offset $pos.
+
+  If fewer than $len bytes follow $pos, everything from $pos to the
+  end of $r is removed.
+
+  On success, returns 0.  On failure (including when $pos is past
+  the end of $r), returns non-zero and $r is left unmodified.
+ */
+int rope_delete(struct rope *r, size_t pos, size_t len)
+{
+	assert(r); // LCOV_EXCL_LINE
+
+	struct rope_node *a, *b, *c, *drop;
+	size_t total = rope_len(r);
+
+	if (pos > total) { return -1; }
+	if (len > total - pos) { len = total - pos; }
+
+	_split(r->root, pos, &a, &b);
+	_split(b, len, &drop, &c);
+	_unref(b);
+	_unref(drop);
+
+	return _commit(r, _join(a, c), total - len);
+}
+
+/**
+  Extract $len bytes of $r, starting at offset $pos, as a new rope.
+
+  As with @rope_concat, the new rope shares as much as it can with
+  $r, so this takes time proportional to the log of the length of $r,
+  regardless of $len.  If fewer than $len bytes follow $pos, the new
+  rope runs to the end of $r.
+
+  On success, returns a new rope, which must be freed with
+  @rope_free.  On failure, returns NULL.
+ */
+struct rope* rope_substr(const struct rope *r, size_t pos, size_t len)
+{
+	assert(r); // LCOV_EXCL_LINE
+
+	struct rope *sub;
+	struct rope_node *a, *b, *c, *rest;
+	size_t total = rope_len(r);
+
+	if (pos > total) { return NULL; }
+	if (len > total - pos) { len = total - pos; }
+
+	if (!(sub = calloc(1, sizeof(struct rope)))) { return NULL; }
+
+	_split(r->root, pos, &a, &b);
+	_split(b, len, &c, &rest);
+	_unref(a);
+	_unref(b);
+	_unref(rest);
+
+	if (_commit(sub, c, len) != 0) {
+		free(sub);
+		return NULL;
+	}
+	return sub;
+}
+
+/**
+  Get the next chunk of $r.
+
+  Ropes store their contents as a sequence of separate chunks of
+  memory.  This function walks through those chunks, in order, using
+  $c to keep track of where it is; $c must be initialized by setting
+  `$c->n` to -1 before the first call (@for_each_chunk does this).
+
+  The length of the chunk is stored in $len.  Chunks are not
+  NULL-terminated, and are only valid until $r is modified or freed.
+
+  Returns a pointer to the next chunk, or NULL once all of $r has
+  been visited.
+ */
+const char* rope_next(const struct rope *r, struct rope_cursor *c, size_t *len)
+{
+	assert(r);   // LCOV_EXCL_LINE
+	assert(c);   // LCOV_EXCL_LINE
+	assert(len); // LCOV_EXCL_LINE
+
+	const struct rope_node *t;
+
+	if (c->n < 0) {
+		c->n = 0;
+		if (r->root) { c->stack[c->n++] = r->root; }
+	}
+
+	if (c->n == 0) {
+		*len = 0;
+		return NULL;
+	}
+
+	for (t = c->stack[--c->n]; t->depth; t = t->left) {
+		c->stack[c->n++] = t->right;
+	}
+
+	*len = t->len;
+	return t->data;
+}
+
+/**
+  Fill $iov with (up to $n of) the next chunks of $r.
+
+  This is a batched form of @rope_next, suitable for handing the
+  contents of a rope to `writev(2)` without flattening it first:
+
+  <code>
+  struct rope_cursor c;
+  struct iovec iov[64];
+  size_t n;
+
+  c.n = -1;
+  while ((n = rope_iov(r, &c, iov, 64)) > 0) {
+      writev(fd, iov, n);  // real code should check for short writes
+  }
+  </code>
+
+  Returns the number of iovecs filled in, which is 0 once all of $r
+  has been visited.
+ */
+size_t rope_iov(const struct rope *r, struct rope_cursor *c, struct iovec *iov, size_t n)
+{
+	size_t i, len;
+	const char *p;
+
+	for (i = 0; i < n && (p = rope_next(r, c, &len)) != NULL; i++) {
+		iov[i].iov_base = (void*)p;
+		iov[i].iov_len  = len;
+	}
+	return i;
+}
+
+/**
+  Flatten $r into a new variable-length string.
+
+  The string is allocated to be exactly as large as it needs to be,
+  and then each chunk of $r is copied into it once.
+
+  On success, returns a new string, which must be freed with
+  @string_free.  On failure, returns NULL.
+ */
+struct string* rope_string(const struct rope *r)
+{
+	assert(r); // LCOV_EXCL_LINE
+
+	struct rope_cursor c;
+	struct string *s;
+	const char *p;
+	size_t len;
+
+	s = string_new(NULL, rope_len(r) + 1);
+	if (!s) { return NULL; }
+
+	for_each_chunk(r, &c, p, len) {
+		string_appendv(s, strview(p, len));
+	}
+	return s;
+}
@@ -0,0 +1,292 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "gear.h"
+
+#ifdef __x86_64__
+#  include <immintrin.h>
+#  define SEARCH_SIMD 1
+#endif
+
+static const char* _set_scalar(const char *s, size_t n, const struct byteset *set)
+{
+	const char *end = s + n;
+	for (; s != end; s++) {
+		if (byteset_has(set, *s)) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static const char* _str_scalar(const char *hay, size_t n, const char *needle, size_t m)
+{
+	const char *p, *last;
+
+	if (m > n) { return NULL; }
+
+	last = hay + n - m;
+	for (p = hay; p <= last; p++) {
+		p = memchr(p, *needle, last - p + 1);
+		if (!p) { break; }
+		if (memcmp(p + 1, needle + 1, m - 1) == 0) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+#ifdef SEARCH_SIMD
+
+static int _avx2(void)
+{
+	static int have = -1;
+	if (have < 0) {
+		__builtin_cpu_init();
+		have = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return have;
+}
+
+/*
+  Classify 32 bytes at a time against an arbitrary set.  Byte c is in
+  the set if bit (c & 7) of map[c >> 3] is set; with c split into its
+  nibbles, that is map[2 * (c >> 4) + ((c >> 3) & 1)].  So the high
+  nibble indexes a row of set->lo and set->hi (16 entries each, one
+  per shuffle lane), bit 3 of the low nibble picks set->lo or set->hi,
+  and the low three bits pick the bit within that byte.
+ */
+__attribute__((target("avx2")))
+static const char* _set_avx2(const char *s, size_t n, const struct byteset *set)
+{
+	const __m256i lotab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->lo));
+	const __m256i hitab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->hi));
+	const __m256i bits  = _mm256_setr_epi8(
+		1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+		1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	const __m256i seven  = _mm256_set1_epi8(7);
+	const __m256i zero   = _mm256_setzero_si256();
+	__m256i v, lo, hi, row, hit;
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		v   = _mm256_loadu_si256((const __m256i*)(s + i));
+		lo  = _mm256_and_si256(v, nibble);
+		hi  = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+		row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lotab, hi),
+		                         _mm256_shuffle_epi8(hitab, hi),
+		                         _mm256_cmpgt_epi8(lo, seven));
+		hit = _mm256_and_si256(row, _mm256_shuffle_epi8(bits, lo));
+
+		mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, zero));
+		if (mask) {
+			return s + i + __builtin_ctz(mask);
+		}
+	}
+	return _set_scalar(s + i, n - i, set);
+}
+
+/* SSE2 has no byte shuffle, so this only handles small sets. */
+static const char* _set_sse2(const char *s, size_t n, const struct byteset *set)
+{
+	__m128i want[8], v, hit;
+	unsigned int mask, k;
+	size_t i;
+
+	for (k = 0; k < set->n; k++) {
+		want[k] = _mm_set1_epi8(set->bytes[k]);
+	}
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		v   = _mm_loadu_si128((const __m128i*)(s + i));
+		hit = _mm_cmpeq_epi8(v, want[0]);
+		for (k = 1; k < set->n; k++) {
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, want[k]));
+		}
+
+		mask = _mm_movemask_epi8(hit);
+		if (mask) {
+			return s + i + __builtin_ctz(mask);
+		}
+	}
+	return _set_scalar(s + i, n - i, set);
+}
+
+/*
+  Look for the first and last bytes of the needle, 32 positions at a
+  time, and only compare the rest of it where both of those match.
+ */
+__attribute__((target("avx2")))
+static const char* _str_avx2(const char *hay, size_t n, const char *needle, size_t m)
+{
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last  = _mm256_set1_epi8(needle[m - 1]);
+	__m256i a, b;
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + m - 1 + 32 <= n; i += 32) {
+		a = _mm256_loadu_si256((const __m256i*)(hay + i));
+		b = _mm256_loadu_si256((const __m256i*)(hay + i + m - 1));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+		                                             _mm256_cmpeq_epi8(b, last)));
+		for (; mask; mask &= mask - 1) {
+			if (memcmp(hay + i + __builtin_ctz(mask) + 1, needle + 1, m - 2) == 0) {
+				return hay + i + __builtin_ctz(mask);
+			}
+		}
+	}
+	return _str_scalar(hay + i, n - i, needle, m);
+}
+
+static const char* _str_sse2(const char *hay, size_t n, const char *needle, size_t m)
+{
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last  = _mm_set1_epi8(needle[m - 1]);
+	__m128i a, b;
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + m - 1 + 16 <= n; i += 16) {
+		a = _mm_loadu_si128((const __m128i*)(hay + i));
+		b = _mm_loadu_si128((const __m128i*)(hay + i + m - 1));
+		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+		                                       _mm_cmpeq_epi8(b, last)));
+		for (; mask; mask &= mask - 1) {
+			if (memcmp(hay + i + __builtin_ctz(mask) + 1, needle + 1, m - 2) == 0) {
+				return hay + i + __builtin_ctz(mask);
+			}
+		}
+	}
+	return _str_scalar(hay + i, n - i, needle, m);
+}
+
+#endif
+
+/************************************************************************/
+
+/**
+  Initialize $set to contain the $n bytes at $bytes.
+
+  A byteset is a 256-bit map of which byte values are in the set,
+  along with some lookup tables derived from it that let
+  @search_set classify many bytes at once.  Setting it up once and
+  reusing it is far cheaper than rebuilding it for each search.
+
+  <code>
+  struct byteset ws;
+  byteset_init(&ws, " \t\r\n", 4);
+  </code>
+ */
+void byteset_init(struct byteset *set, const char *bytes, size_t n)
+{
+	assert(set); // LCOV_EXCL_LINE
+
+	unsigned int c, i;
+
+	memset(set, 0, sizeof(struct byteset));
+	for (; n > 0; n--, bytes++) {
+		set->map[(unsigned char)*bytes >> 3] |= 1 << ((unsigned char)*bytes & 7);
+	}
+
+	for (i = 0; i < 16; i++) {
+		set->lo[i] = set->map[i * 2];
+		set->hi[i] = set->map[i * 2 + 1];
+	}
+	for (c = 0; c < 256; c++) {
+		if (byteset_has(set, c)) {
+			if (set->n < sizeof(set->bytes)) {
+				set->bytes[set->n] = c;
+			}
+			set->n++;
+		}
+	}
+}
+
+/**
+  Find the first occurrence of byte $c in the $n bytes at $s.
+
+  This is `memchr(3)`, which the C library already implements with
+  whatever vector instructions the CPU has to offer; it is here so
+  that all of the search primitives can be found in one place.
+
+  Returns a pointer to the matching byte, or NULL if $c was not found.
+ */
+const char* search_byte(const char *s, size_t n, char c)
+{
+	return n ? memchr(s, c, n) : NULL;
+}
+
+/**
+  Find the first of the $n bytes at $s that is in $set.
+
+  This is the vectorized counterpart of `strpbrk(3)`, for buffers that
+  aren't NULL-terminated.  On CPUs that support AVX2, 32 bytes are
+  checked at a time, regardless of how many bytes are in $set.
+  Otherwise, SSE2 is used to check 16 bytes at a time against small
+  sets (up to 8 bytes), and anything else is checked a byte at a time.
+
+  Returns a pointer to the matching byte, or NULL if no byte from
+  $set was found.
+ */
+const char* search_set(const char *s, size_t n, const struct byteset *set)
+{
+	assert(set); // LCOV_EXCL_LINE
+
+	if (set->n == 0 || n == 0) { return NULL; }
+	if (set->n == 1) { return memchr(s, set->bytes[0], n); }
+
+#ifdef SEARCH_SIMD
+	if (_avx2()) { return _set_avx2(s, n, set); }
+	if (set->n <= sizeof(set->bytes)) { return _set_sse2(s, n, set); }
+#endif
+	return _set_scalar(s, n, set);
+}
+
+/**
+  Find the first occurrence of the $m-byte $needle in the $n bytes at $hay.
+
+  Candidate positions are found by comparing the first and last bytes
+  of $needle against 32 (AVX2) or 16 (SSE2) positions of $hay at once,
+  and the rest of $needle is only compared where both of those match.
+  On other platforms, candidates are found with `memchr(3)`.
+
+  An empty $needle is found at the start of $hay.
+
+  Returns a pointer to the start of the match, or NULL if $needle
+  was not found.
+ */
+const char* search_str(const char *hay, size_t n, const char *needle, size_t m)
+{
+	if (m == 0) { return hay; }
+	if (m > n) { return NULL; }
+	if (m == 1) { return memchr(hay, *needle, n); }
+
+#ifdef SEARCH_SIMD
+	if (_avx2()) { return _str_avx2(hay, n, needle, m); }
+	return _str_sse2(hay, n, needle, m);
+#else
+	return _str_scalar(hay, n, needle, m);
+#endif
+}
@@ -24,69 +24,337 @@
 #include <string.h>
 #include <stdarg.h>
 #include <ctype.h>
-
-#define SI_COPY 0
-#define SI_SREF 1 /* "simple" reference:  $([a-zA-Z][a-zA-Z0-9]*) */
-#define SI_CREF 2 /* "complex" reference: ${([a-zA-Z][^}]*)} */
-#define SI_ESC  3 /* a leading '\' for escaping '$' */
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define INIT_LEN   16
 
+/* sizes of the blocks that back arena-mode stringlists */
+#define ARENA_MIN  4096
+#define ARENA_MAX  (4 * 1024 * 1024)
+
+/* stringlist->flags */
+#define SL_ARENA   0x01  /* strings live in sl->blocks */
+#define SL_SORTED  0x02  /* strings are in STRINGLIST_SORT_ASC order */
+
 #define EXPAND_FACTOR 8
 #define EXPAND_LEN(x) (x / EXPAND_FACTOR + 1) * EXPAND_FACTOR
 
-static char*  _extract(const char *start, const char *end);
-static char*  _lookup(const char *ref, const struct hash *ctx);
-static int    _deref(char **buf, size_t *n, const char *start, const char *end, const struct hash *ctx);
+/* fewest strings per thread worth sorting in parallel */
+#define PSORT_MIN 65536
+
+/* fewest bytes per thread worth splitting in parallel */
+#define PSPLIT_MIN (1024 * 1024)
+
+/* partitions this small are insertion-sorted by _sl_msort() */
+#define MSORT_CUTOFF 16
+
+/* number of iovecs batched up before a writev(2) */
+#define IOB_MAX 64
+
+/* emits $n bytes of interpolated output; non-zero stops the walk */
+typedef int (*si_emitter)(void *udata, const char *s, size_t n);
+
+/* finds the value of a reference, or returns NULL */
+typedef const char* (*si_lookup)(void *ctx, struct strview ref);
+
+struct _si_buf {
+	char   *p;     /* next byte to write */
+	size_t  left;  /* free bytes, excluding the NULL-terminator */
+};
+
+/* per-render state for string_render() and friends */
+struct _si_memo {
+	struct resolver *r;
+	struct hash     *seen;    /* ref -> value, or _si_unresolved */
+	int              failed;
+};
+
+/* marks references that no resolver could resolve */
+static char _si_unresolved[] = "";
+
+struct _iob {
+	int          fd;
+	int          n;
+	struct iovec iov[IOB_MAX];
+};
+
+/* per-thread buffer for string_scratch() */
+struct _scratch {
+	char   *buf;
+	size_t  size;
+};
+
+static pthread_key_t  SCRATCH_KEY;
+static pthread_once_t SCRATCH_ONCE = PTHREAD_ONCE_INIT;
+
+/* a piece of work for stringlist_sort_parallel(): sort $a, or
+   merge $a and $b into $out */
+struct _psort {
+	char          **a, **b, **out;
+	size_t          na, nb;
+	sl_comparator   cmp;
+	pthread_t       tid;
+	int             started;
+};
+
+/* one thread's share of a parallel split (see stringlist_split_parallel) */
+struct _psplit {
+	const char         *p;
+	size_t              len;
+	const char         *delim;
+	int                 opt;
+	struct stringlist  *out;
+	pthread_t           tid;
+	int                 started;
+};
+
+/* the rest of one of the lists being merged by stringlist_merge() */
+struct _mstream {
+	char  **v;    /* next string */
+	char  **end;
+	size_t  id;   /* which list; breaks ties, so that the merge is stable */
+};
+
+/* a string being sorted, and the 8 bytes of it that matter right now */
+struct _skey {
+	uint64_t  pfx;  /* bytes [depth, depth+8), big-endian, 0-padded */
+	char     *s;
+};
+
+/* a chunk of storage for the strings in an arena-mode stringlist */
+struct sl_block {
+	struct sl_block *next;
+	size_t           used;
+	size_t           size;
+	char             data[];
+};
+
+/* a file mapped into memory, that a stringlist's strings point into */
+struct sl_map {
+	void   *addr;
+	size_t  len;
+};
+
+/* a slot in an open-addressed set of strings (see _strset_*) */
+struct _strent {
+	const char   *s;     /* NULL for unused slots */
+	size_t        len;
+	unsigned int  hash;  /* strview_hash() of s */
+	size_t        n;     /* for use by the owner of the set */
+};
+
+struct _strset {
+	size_t          num;    /* number of used slots */
+	size_t          mask;   /* number of slots, less one (a power of 2) */
+	struct _strent *slots;
+};
+
+/* interned strings; the pointer handed out is ->str */
+struct _istr {
+	size_t        len;
+	unsigned int  hash;
+	char          str[];
+};
+#define _istr_of(s) ((struct _istr*)((char*)(s) - offsetof(struct _istr, str)))
+
+struct strtab {
+	struct _strset set;
+};
+
+/* membership index for a stringlist; keys are copies, ->n counts
+   occurrences in the list (entries are removed when it reaches zero) */
+struct sl_index {
+	struct _strset set;
+};
+
+static int    _si_deref(const char *start, const char *end, si_lookup lookup, void *ctx, si_emitter emit, void *udata);
+static int    _si_walk(const char *src, si_lookup lookup, void *ctx, si_emitter emit, void *udata);
 static int    _sl_expand(struct stringlist*, size_t);
 static int    _sl_reduce(struct stringlist*);
 static size_t _sl_capacity(struct stringlist*);
+static int    _sl_index_add(struct sl_index*, struct strview);
+static void   _sl_index_drop(struct sl_index*, const char*);
+
+static int _si_deref(const char *start, const char *end, si_lookup lookup, void *ctx, si_emitter emit, void *udata)
+{
+	struct strview ref = strview(start, end - start);
+	const char *val = lookup(ctx, ref);
+
+	DEBUG("string:deref ::%.*s:: -> '%s'\n", (int)ref.len, ref.p, val ? val : "");
+	return val ? emit(udata, val, strlen(val)) : 0;
+}
+
+/*
+  Walk $src, handing literal spans and the values that $lookup finds
+  for each reference to $emit, in order.  Literal spans point into $src
+  and values are whatever $lookup returns, so nothing is copied here;
+  it is up to $emit to decide where the bytes go.
+ */
+static int _si_walk(const char *src, si_lookup lookup, void *ctx, si_emitter emit, void *udata)
+{
+	/* what byteset_init(&special, "$\\", 2) would build, once and for
+	   all: '$' (0x24) is in an even byte of the map, so it shows up
+	   in lo; '\\' (0x5c) is in an odd one, so it shows up in hi */
+	static const struct byteset special = {
+		.map   = { ['$'  >> 3] = 1 << ('$'  & 7), ['\\' >> 3] = 1 << ('\\' & 7) },
+		.lo    = { ['$'  >> 4] = 1 << ('$'  & 7) },
+		.hi    = { ['\\' >> 4] = 1 << ('\\' & 7) },
+		.bytes = { '$', '\\' },
+		.n     = 2,
+	};
+	const char *a, *ref, *end;
+	int rc;
+
+	end = src + strlen(src);
+
+	for (a = src; (src = search_set(src, end - src, &special)) != NULL; ) {
+		if ((rc = emit(udata, a, src - a)) != 0) { return rc; }
+
+		if (*src == '\\') {
+			a = ++src; /* escaped character starts the next span */
+			if (src != end) { src++; }
+			continue;
+		}
+
+		if (*++src == '{') {
+			ref = ++src;
+			if (!(src = search_byte(ref, end - ref, '}'))) {
+				src = end;
+			}
+			rc = _si_deref(ref, src, lookup, ctx, emit, udata);
+			if (src != end) { src++; }
+
+		} else {
+			for (ref = src; isalnum((unsigned char)*src); src++)
+				;
+			rc = _si_deref(ref, src, lookup, ctx, emit, udata);
+		}
+		if (rc != 0) { return rc; }
+		a = src;
+	}
+
+	return emit(udata, a, end - a);
+}
 
-static char* _extract(const char *start, const char *end)
+static const char* _si_fromhash(void *ctx, struct strview ref)
 {
-	size_t len = end - start + 1;
-	char *buf = calloc(len, sizeof(char));
-	if (!buf) { return NULL; }
+	return hash_getv((const struct hash*)ctx, ref);
+}
+
+/* consult the resolver chain, at most once per distinct reference */
+static const char* _si_resolve(void *ctx, struct strview ref)
+{
+	struct _si_memo *m = (struct _si_memo*)ctx;
+	struct resolver *r;
+	char *val;
+
+	if ((val = hash_getv(m->seen, ref)) != NULL) {
+		return val == _si_unresolved ? NULL : val;
+	}
 
-	if (!strncpy(buf, start, len-1)) {
-		free(buf);
+	for (r = m->r; r && !val; r = r->next) {
+		val = r->resolve(ref, r->udata);
+	}
+	if (!hash_setv(m->seen, ref, val ? val : _si_unresolved)) {
+		free(val);
+		m->failed = 1;
 		return NULL;
 	}
+	return val;
+}
+
+static int _si_memo_init(struct _si_memo *m, struct resolver *r)
+{
+	m->r = r;
+	m->failed = 0;
+	return (m->seen = hash_new()) != NULL ? 0 : -1;
+}
+
+static void _si_memo_free(struct _si_memo *m)
+{
+	struct hash_cursor cur;
+	char *k, *v;
 
-	return buf;
+	for_each_key_value(m->seen, &cur, k, v) {
+		if (v != _si_unresolved) { free(v); }
+	}
+	hash_free(m->seen);
 }
 
-static char* _lookup(const char *ref, const struct hash *ctx)
+static int _si_tobuf(void *udata, const char *s, size_t n)
 {
-	const char *value = hash_get(ctx, ref);
-	return strdup(value ? value : "");
+	struct _si_buf *b = (struct _si_buf*)udata;
+
+	if (n > b->left) { n = b->left; }
+	memcpy(b->p, s, n);
+	b->p    += n;
+	b->left -= n;
+
+	return b->left == 0 ? 1 : 0;
 }
 
-static int _deref(char **buf, size_t *len, const char *start, const char *end, const struct hash *ctx)
+static int _iob_flush(struct _iob *b)
 {
-	char *ref = _extract(start, end);
-	char *val = _lookup(ref, ctx);
+	struct iovec *v = b->iov;
+	int n = b->n;
+	ssize_t w;
+
+	while (n > 0) {
+		w = writev(b->fd, v, n);
+		if (w < 0) {
+			if (errno == EINTR) { continue; }
+			return -1;
+		}
 
-	DEBUG("string:deref ::%s:: -> '%s'\n", ref, val);
+		/* skip past everything written; adjust a partial iovec */
+		for (; n > 0 && (size_t)w >= v->iov_len; w -= v->iov_len, v++, n--)
+			;
+		if (n > 0) {
+			v->iov_base = (char*)v->iov_base + w;
+			v->iov_len -= w;
+		}
+	}
 
-	strncat(*buf, val, *len);
-	for (; **buf; (*buf)++, (*len)--)
-		;
+	b->n = 0;
+	return 0;
+}
 
-	free(ref);
-	free(val);
+static int _iob_add(struct _iob *b, const char *s, size_t n)
+{
+	if (n == 0) { return 0; }
+	if (b->n == IOB_MAX && _iob_flush(b) != 0) { return -1; }
 
+	b->iov[b->n].iov_base = (void*)s;
+	b->iov[b->n].iov_len  = n;
+	b->n++;
 	return 0;
 }
 
-#define bufcopyc(b,c,l) do {\
-	if ((l) > 0) { (l)--; *(b)++ = (c); } \
-} while(0)
+static int _si_tofd(void *udata, const char *s, size_t n)
+{
+	return _iob_add((struct _iob*)udata, s, n);
+}
+
+static int _si_toFILE(void *udata, const char *s, size_t n)
+{
+	return fwrite(s, 1, n, (FILE*)udata) == n ? 0 : -1;
+}
 
 static int _extend(struct string *s, size_t n)
 {
 	char *tmp;
 	if (n >= s->bytes) {
+		/* grow geometrically, so that n appends cost O(n) copying */
+		if (n < s->bytes * 2) {
+			n = s->bytes * 2;
+		}
 		n = (n / s->blk + 1) * s->blk;
 		if (!(tmp = realloc(s->raw, n))) {
 			return -1;
@@ -107,6 +375,11 @@ static int _sl_expand(struct stringlist *sl, size_t expand)
 	assert(expand > 0); // LCOV_EXCL_LINE
 
 	char **s;
+
+	/* grow geometrically, so that n appends cost O(n) copying */
+	if (expand < sl->len) {
+		expand = sl->len;
+	}
 	expand = EXPAND_LEN(expand) + sl->len;
 	s = realloc(sl->strings, expand * sizeof(char *));
 	if (!s) {
@@ -121,33 +394,335 @@ static int _sl_expand(struct stringlist *sl, size_t expand)
 	return 0;
 }
 
-/* Remove NULL strings from $sl. */
+/* Remove NULL strings from $sl, keeping the rest in order. */
 static int _sl_reduce(struct stringlist *sl)
 {
-	char **ins; char **ptr, **end;
+	size_t i, n;
+
+	for (i = n = 0; i < sl->num; i++) {
+		if (sl->strings[i]) {
+			sl->strings[n++] = sl->strings[i];
+		}
+	}
+	for (i = n; i < sl->num; i++) {
+		sl->strings[i] = NULL;
+	}
+
+	sl->num = n;
+	return 0;
+}
+
+static size_t _sl_capacity(struct stringlist *sl)
+{
+	return sl->len - 1 - sl->num;
+}
+
+static void _scratch_free(void *p)
+{
+	struct _scratch *sc = (struct _scratch*)p;
+	free(sc->buf);
+	free(sc);
+}
+
+static void _scratch_init(void)
+{
+	pthread_key_create(&SCRATCH_KEY, _scratch_free);
+}
+
+static struct _scratch* _scratch(void)
+{
+	struct _scratch *sc;
+
+	pthread_once(&SCRATCH_ONCE, _scratch_init);
+	if ((sc = pthread_getspecific(SCRATCH_KEY)) != NULL) {
+		return sc;
+	}
+
+	sc = calloc(1, sizeof(struct _scratch));
+	if (!sc) { return NULL; }
+
+	sc->size = 256;
+	sc->buf  = malloc(sc->size);
+	if (!sc->buf || pthread_setspecific(SCRATCH_KEY, sc) != 0) {
+		free(sc->buf);
+		free(sc);
+		return NULL;
+	}
+	return sc;
+}
+
+/* Make sure the current arena block of $sl has room for $n more bytes. */
+static int _sl_reserve_bytes(struct stringlist *sl, size_t n)
+{
+	struct sl_block *b = sl->blocks;
+	size_t size;
+
+	if (b && b->size - b->used >= n) { return 0; }
+
+	/* blocks double in size (up to a point), so that a list of
+	   any size is backed by a handful of them */
+	size = b ? b->size * 2 : ARENA_MIN;
+	if (size > ARENA_MAX) { size = ARENA_MAX; }
+	if (size < n)         { size = n; }
+
+	b = malloc(sizeof(struct sl_block) + size);
+	if (!b) { return -1; }
+
+	b->used = 0;
+	b->size = size;
+	b->next = sl->blocks;
+	sl->blocks = b;
+	return 0;
+}
+
+/* Copy $v into the arena of $sl. */
+static char* _sl_arena_dup(struct stringlist *sl, struct strview v)
+{
+	char *s;
+
+	if (_sl_reserve_bytes(sl, v.len + 1) != 0) { return NULL; }
+
+	s = sl->blocks->data + sl->blocks->used;
+	memcpy(s, v.p, v.len);
+	s[v.len] = '\0';
+	sl->blocks->used += v.len + 1;
+	return s;
+}
+
+/* Make a copy of $v for $sl to keep, according to how it stores strings. */
+static char* _sl_strdup(struct stringlist *sl, struct strview v)
+{
+	if (sl->index && _sl_index_add(sl->index, v) != 0) {
+		return NULL;
+	}
+	if (sl->strtab) {
+		return (char*)strtab_internv(sl->strtab, v);
+	}
+	if (sl->flags & SL_ARENA) {
+		return _sl_arena_dup(sl, v);
+	}
+	return strview_dup(v);
+}
+
+/* Let go of a string that was stored in $sl. */
+static void _sl_release(struct stringlist *sl, char *s)
+{
+	if (sl->index) {
+		_sl_index_drop(sl->index, s);
+	}
+	/* arena strings are reclaimed all at once, by stringlist_free() */
+	if (!sl->strtab && !(sl->flags & SL_ARENA)) {
+		free(s);
+	}
+}
+
+/* Total size of the strings in $src, with their NULL-terminators. */
+static size_t _sl_bytes(char **src, size_t n)
+{
+	size_t i, total = 0;
+	for (i = 0; i < n; i++) {
+		total += strlen(src[i]) + 1;
+	}
+	return total;
+}
+
+static int _strset_init(struct _strset *set, size_t hint)
+{
+	size_t size = 16;
+	while (size < hint * 2) {
+		size <<= 1;
+	}
+
+	set->num   = 0;
+	set->mask  = size - 1;
+	set->slots = calloc(size, sizeof(struct _strent));
+	return set->slots ? 0 : -1;
+}
+
+static void _strset_free(struct _strset *set)
+{
+	free(set->slots);
+	set->slots = NULL;
+}
+
+/* Find the slot for $v, which is either its slot, or an unused one. */
+static struct _strent* _strset_slot(const struct _strset *set, struct strview v, unsigned int h)
+{
+	struct _strent *e;
+	size_t i;
+
+	for (i = h & set->mask; ; i = (i + 1) & set->mask) {
+		e = &set->slots[i];
+		if (!e->s || (e->hash == h && e->len == v.len && memcmp(e->s, v.p, v.len) == 0)) {
+			return e;
+		}
+	}
+}
+
+/* Make sure $n more strings can be added without the set filling up. */
+static int _strset_reserve(struct _strset *set, size_t n)
+{
+	struct _strset bigger;
+	struct _strent *e;
+	size_t i;
+
+	if ((set->num + n) * 2 <= set->mask + 1) {
+		return 0;
+	}
 
-	ptr = ins = sl->strings;
-	end = sl->strings + sl->num;
-	while (ins < end) {
-		while (!*ptr && ptr++ < end) {
-			sl->num--;
+	if (_strset_init(&bigger, set->num + n) != 0) {
+		return -1;
+	}
+	for (i = 0; i <= set->mask; i++) {
+		e = &set->slots[i];
+		if (e->s) {
+			*_strset_slot(&bigger, strview(e->s, e->len), e->hash) = *e;
 		}
+	}
+
+	bigger.num = set->num;
+	free(set->slots);
+	*set = bigger;
+	return 0;
+}
 
-		/*
-		if (ptr == end) {
+/* Empty slot $e, shifting back any entries after it that were
+   displaced past it, so that no lookup runs into the hole early. */
+static void _strset_remove(struct _strset *set, struct _strent *e)
+{
+	size_t i, j, k;
+
+	i = j = e - set->slots;
+	for (;;) {
+		j = (j + 1) & set->mask;
+		if (!set->slots[j].s) {
 			break;
 		}
-		*/
 
-		*ins++ = *ptr++;
+		/* entry $j belongs at $k; it can move back into the hole at
+		   $i only if $k is not (cyclically) in between $i and $j */
+		k = set->slots[j].hash & set->mask;
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+			set->slots[i] = set->slots[j];
+			i = j;
+		}
 	}
 
+	memset(&set->slots[i], 0, sizeof(struct _strent));
+	set->num--;
+}
+
+/* Count one more occurrence of $v in $idx. */
+static int _sl_index_add(struct sl_index *idx, struct strview v)
+{
+	struct _strent *e;
+	unsigned int h = strview_hash(v);
+
+	e = _strset_slot(&idx->set, v, h);
+	if (!e->s) {
+		if (_strset_reserve(&idx->set, 1) != 0) { return -1; }
+		e = _strset_slot(&idx->set, v, h);
+		if (!(e->s = strview_dup(v))) { return -1; }
+		e->len  = v.len;
+		e->hash = h;
+		e->n    = 0;
+		idx->set.num++;
+	}
+	e->n++;
 	return 0;
 }
 
-static size_t _sl_capacity(struct stringlist *sl)
+/* Count one less occurrence of $s in $idx. */
+static void _sl_index_drop(struct sl_index *idx, const char *s)
 {
-	return sl->len - 1 - sl->num;
+	struct strview v = strview_cstr(s);
+	struct _strent *e = _strset_slot(&idx->set, v, strview_hash(v));
+	if (e->s && --e->n == 0) {
+		free((char*)e->s);
+		_strset_remove(&idx->set, e);
+	}
+}
+
+static void _sl_index_free(struct sl_index *idx)
+{
+	size_t i;
+	if (idx) {
+		for (i = 0; i <= idx->set.mask; i++) {
+			free((char*)idx->set.slots[i].s);
+		}
+		_strset_free(&idx->set);
+	}
+	free(idx);
+}
+
+/* Is $sl in ascending (strcmp) order? */
+static int _sl_sorted(const struct stringlist *sl)
+{
+	size_t i;
+	if (sl->flags & SL_SORTED) { return 1; }
+	for (i = 1; i < sl->num; i++) {
+		if (strcmp(sl->strings[i-1], sl->strings[i]) > 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+  For each string a->strings[i], count how many times it appears in $b,
+  and store that in $count[i].  If both lists are already sorted, this
+  is a merge of the two; otherwise the strings of $b are counted in a
+  temporary hash set.  Either way, it takes (expected) linear time.
+ */
+static int _sl_counts(const struct stringlist *a, const struct stringlist *b, size_t *count)
+{
+	struct _strset set;
+	struct _strent *e;
+	struct strview v;
+	unsigned int h;
+	size_t i, j, k;
+	int c;
+
+	if (_sl_sorted(a) && _sl_sorted(b)) {
+		for (i = j = 0; i < a->num; i++) {
+			/* a run of equal strings in $a shares one count */
+			if (i > 0 && strcmp(a->strings[i], a->strings[i-1]) == 0) {
+				count[i] = count[i-1];
+				continue;
+			}
+			for (c = 1; j < b->num && (c = strcmp(b->strings[j], a->strings[i])) < 0; j++)
+				;
+			for (k = j; c == 0 && k < b->num && strcmp(b->strings[k], a->strings[i]) == 0; k++)
+				;
+			count[i] = k - j;
+			j = k; /* each run of $b is only walked once */
+		}
+		return 0;
+	}
+
+	if (_strset_init(&set, b->num) != 0) { return -1; }
+	for_each_string(b,j) {
+		v = strview_cstr(b->strings[j]);
+		h = strview_hash(v);
+		e = _strset_slot(&set, v, h);
+		if (!e->s) {
+			e->s    = v.p;
+			e->len  = v.len;
+			e->hash = h;
+			e->n    = 0;
+			set.num++;
+		}
+		e->n++;
+	}
+
+	for_each_string(a,i) {
+		v = strview_cstr(a->strings[i]);
+		e = _strset_slot(&set, v, strview_hash(v));
+		count[i] = e->s ? e->n : 0;
+	}
+
+	_strset_free(&set);
+	return 0;
 }
 
 /*****************************************************************/
@@ -194,6 +769,57 @@ char* string(const char *fmt, ...)
 	return buf2;
 }
 
+/**
+  Format a temporary string, with printf-like behavior.
+
+  This works like @string, except that the result is formatted into
+  a buffer that belongs to the calling thread, and is reused by the
+  next call to `string_scratch` from that same thread.  The buffer
+  grows as needed, and is freed when the thread exits, so there is
+  nothing to `free(3)`, and once the buffer is large enough, there is
+  no memory allocation at all.
+
+  This makes it a good fit for strings that are used once and then
+  discarded right away, like log messages:
+
+  <code>
+  syslog(LOG_INFO, "%s", string_scratch("%s: %u records", name, n));
+  </code>
+
+  Returns a pointer to the formatted string, which is only valid until
+  the next call to `string_scratch` in the same thread.  On failure,
+  returns NULL.
+ */
+const char* string_scratch(const char *fmt, ...)
+{
+	struct _scratch *sc;
+	size_t size;
+	char *buf;
+	va_list args;
+	int n;
+
+	if (!(sc = _scratch())) { return NULL; }
+
+	va_start(args, fmt);
+	n = vsnprintf(sc->buf, sc->size, fmt, args);
+	va_end(args);
+	if (n < 0) { return NULL; }
+
+	if ((size_t)n >= sc->size) {
+		for (size = sc->size * 2; size <= (size_t)n; size *= 2)
+			;
+		if (!(buf = realloc(sc->buf, size))) { return NULL; }
+		sc->buf  = buf;
+		sc->size = size;
+
+		va_start(args, fmt);
+		vsnprintf(sc->buf, sc->size, fmt, args);
+		va_end(args);
+	}
+
+	return sc->buf;
+}
+
 /**
   Create a new variable-length string
 
@@ -202,7 +828,7 @@ char* string(const char *fmt, ...)
 
   $block can be used to influence the memory management of the
   string.  When more memory is needed, it will be allocated in
-  multiples of $block.  
+  multiples of $block, and the buffer will at least double in size.  
   If $block is negative, a suitable default block size will
   be used.
 
@@ -257,12 +883,7 @@ void string_free(struct string *s)
 int string_append(struct string *s, const char *str)
 {
 	if (!str) { return 0; }
-	if (_extend(s, s->len + strlen(str)) != 0) { return -1; }
-
-	for (; *str; *s->p++ = *str++, s->len++)
-		;
-	*s->p = '\0';
-	return 0;
+	return string_appendv(s, strview_cstr(str));
 }
 
 /**
@@ -288,6 +909,73 @@ int string_append1(struct string *s, char c)
 	return 0;
 }
 
+/**
+  Append a formatted string to the end of $s, with printf-like behavior.
+
+  The string is formatted straight into the free space at the end of
+  $s; only if it does not fit is $s expanded and the string formatted
+  a second time.
+
+  <code>
+  struct string *s = string_new("Forty-two", 0);
+  string_appendf(s, " = %u", 42);
+  // s->raw is now "Forty-two = 42"
+  </code>
+
+  On success, returns 0.  On failure, returns non-zero and
+  $s is left unmodified.
+ */
+int string_appendf(struct string *s, const char *fmt, ...)
+{
+	va_list args;
+	size_t left = s->bytes - s->len; /* including the NULL-terminator */
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(s->p, left, fmt, args);
+	va_end(args);
+
+	if (n >= 0 && (size_t)n >= left) {
+		if (_extend(s, s->len + n) != 0) {
+			n = -1;
+		} else {
+			va_start(args, fmt);
+			vsnprintf(s->p, n + 1, fmt, args);
+			va_end(args);
+		}
+	}
+
+	if (n < 0) {
+		*s->p = '\0';
+		return -1;
+	}
+
+	s->p   += n;
+	s->len += n;
+	return 0;
+}
+
+/**
+  Append the bytes viewed by $v to the end of $s
+
+  This is the same as @string_append, except that the appended
+  bytes do not need to be NULL-terminated.  Any NULL bytes within
+  $v will be copied verbatim.
+
+  On success, returns 0.  On failure, returns non-zero and
+  $s is left unmodified.
+ */
+int string_appendv(struct string *s, struct strview v)
+{
+	if (_extend(s, s->len + v.len) != 0) { return -1; }
+
+	memcpy(s->p, v.p, v.len);
+	s->p   += v.len;
+	s->len += v.len;
+	*s->p = '\0';
+	return 0;
+}
+
 /**
   Interpolate variable references in $src against $ctx
 
@@ -318,68 +1006,620 @@ int string_interpolate(char *buf, size_t len, const char *src, const struct hash
 	assert(src); // LCOV_EXCL_LINE
 	assert(ctx); // LCOV_EXCL_LINE
 
-	int state = SI_COPY;
-	const char *ref;
+	struct _si_buf b = { buf, len - 1 }; /* leave room for the trailing \0 */
 
-	memset(buf, 0, len);
-	//char *debug = buf;
+	_si_walk(src, _si_fromhash, (void*)ctx, _si_tobuf, &b);
+	*b.p = '\0';
 
-	--len; // we really only have len-1 character slots (trailing \0)
-	while (*src && len > 0) {
-		if (state == SI_SREF) {
-			if (!isalnum(*src)) {
-				_deref(&buf, &len, ref, src, ctx);
-				state = SI_COPY;
-			}
-		} else if (state == SI_CREF) {
-			if (*src == '}') {
-				_deref(&buf, &len, ref, src, ctx);
-				src++;
-				state = SI_COPY;
-			}
-		}
+	return 0;
+}
 
-		if (state == SI_ESC) {
-			bufcopyc(buf, *src++, len);
-			state = SI_COPY;
-			continue;
-		}
+/**
+  Interpolate $src against $ctx, writing the result to $fd
 
-		if (state == SI_COPY) {
-			if (*src == '\\') {
-				state = SI_ESC;
-				src++;
-				continue;
+  This function follows the same interpolation rules as @string_interpolate,
+  but instead of expanding into a caller-supplied buffer, it hands the literal
+  parts of $src and the values looked up in $ctx to the kernel in batches,
+  via `writev(2)`.  The expanded string is never assembled in memory, so
+  there is no upper bound on its size, and no truncation.
 
-			} else if (*src == '$') {
-				state = SI_SREF;
-				src++;
+  Short writes and interrupted system calls are retried transparently.
 
-				if (*src && *src == '{') {
-					state = SI_CREF;
-					src++;
-				}
+  On success, returns 0.  On failure (i.e. a write error), returns non-zero
+  and `errno` is set appropriately; some of the output may have already been
+  written to $fd.
+ */
+int string_interpolate_fd(int fd, const char *src, const struct hash *ctx)
+{
+	assert(src); // LCOV_EXCL_LINE
+	assert(ctx); // LCOV_EXCL_LINE
 
-				ref = src;
-				continue;
-			}
+	struct _iob b;
 
-			bufcopyc(buf, *src, len);
-		}
+	b.fd = fd;
+	b.n  = 0;
+	if (_si_walk(src, _si_fromhash, (void*)ctx, _si_tofd, &b) != 0) {
+		return -1;
+	}
+	return _iob_flush(&b);
+}
+
+/**
+  Interpolate $src against $ctx, writing the result to $io
+
+  This is the stdio counterpart of @string_interpolate_fd; each literal
+  span and each value is handed to `fwrite(3)` as-is, and buffering is
+  left to $io.
+
+  On success, returns 0.  On failure, returns non-zero.
+ */
+int string_interpolate_FILE(FILE *io, const char *src, const struct hash *ctx)
+{
+	assert(io);  // LCOV_EXCL_LINE
+	assert(src); // LCOV_EXCL_LINE
+	assert(ctx); // LCOV_EXCL_LINE
+
+	return _si_walk(src, _si_fromhash, (void*)ctx, _si_toFILE, io) == 0 ? 0 : -1;
+}
+
+/**
+  Interpolate $src, looking up references with the resolver chain $r
+
+  This function follows the same interpolation rules as @string_interpolate,
+  but instead of looking references up in a hash, it asks each resolver
+  in the chain that starts at $r, in turn, until one of them returns a
+  value.  References that no resolver knows about expand to nothing.
+
+  Values are only resolved if they are actually referenced, and each
+  distinct reference is resolved at most once per call, no matter how
+  many times it appears in $src.  Resolved values are freed before
+  this function returns.
+
+  <code>
+  struct resolver env  = { RESOLVE_ENV,  NULL, NULL };
+  struct resolver vars = { RESOLVE_HASH, ctx,  &env };
+
+  // look in ctx first, then in the environment
+  string_render(buf, sizeof(buf), "$USER@$host:$HOME", &vars);
+  </code>
+
+  As with @string_interpolate, at most $len - 1 bytes of the result
+  (plus a NULL-terminator) are stored in $buf.
+
+  On success, returns 0.  On failure, returns non-zero.
+ */
+int string_render(char *buf, size_t len, const char *src, struct resolver *r)
+{
+	assert(buf); // LCOV_EXCL_LINE
+	assert(src); // LCOV_EXCL_LINE
+
+	struct _si_buf b = { buf, len - 1 }; /* leave room for the trailing \0 */
+	struct _si_memo m;
 
-		src++;
+	*buf = '\0';
+	if (_si_memo_init(&m, r) != 0) { return -1; }
+
+	_si_walk(src, _si_resolve, &m, _si_tobuf, &b);
+	*b.p = '\0';
+
+	_si_memo_free(&m);
+	return m.failed ? -1 : 0;
+}
+
+/**
+  Interpolate $src against the resolver chain $r, writing the result to $fd
+
+  This is to @string_render what @string_interpolate_fd is to
+  @string_interpolate.
+
+  On success, returns 0.  On failure, returns non-zero.
+ */
+int string_render_fd(int fd, const char *src, struct resolver *r)
+{
+	assert(src); // LCOV_EXCL_LINE
+
+	struct _iob b;
+	struct _si_memo m;
+	int rc;
+
+	if (_si_memo_init(&m, r) != 0) { return -1; }
+
+	b.fd = fd;
+	b.n  = 0;
+	rc = _si_walk(src, _si_resolve, &m, _si_tofd, &b);
+	/* the batched iovecs point at resolved values; flush before freeing them */
+	if (rc == 0) { rc = _iob_flush(&b); }
+
+	_si_memo_free(&m);
+	return (rc != 0 || m.failed) ? -1 : 0;
+}
+
+/**
+  Resolve $ref by looking it up in the hash $udata
+
+  This is a resolver function (see @string_render), for use as the
+  `resolve` member of a `struct resolver` whose `udata` is a `struct hash`.
+  Values in the hash must be NULL-terminated strings.
+
+  Returns a copy of the value, or NULL if $ref is not in the hash.
+ */
+char* RESOLVE_HASH(struct strview ref, void *udata)
+{
+	const char *v = hash_getv((const struct hash*)udata, ref);
+	return v ? strdup(v) : NULL;
+}
+
+/**
+  Resolve $ref by looking it up in the environment
+
+  This is a resolver function (see @string_render); its `udata` is
+  not used.
+
+  Returns a copy of the environment variable's value, or NULL if
+  it is not set.
+ */
+char* RESOLVE_ENV(struct strview ref, void *udata)
+{
+	char buf[256], *name = buf, *v;
+	(void)udata;
+
+	/* most names fit on the stack; longer ones get the heap */
+	if (ref.len >= sizeof(buf) && !(name = malloc(ref.len + 1))) {
+		return NULL;
 	}
+	memcpy(name, ref.p, ref.len);
+	name[ref.len] = '\0';
+
+	v = getenv(name);
+	v = v ? strdup(v) : NULL;
+
+	if (name != buf) { free(name); }
+	return v;
+}
+
+/**
+  Replace every occurrence of $find in the $len bytes at $src with $with.
 
-	if (state != SI_COPY) {
-		_deref(&buf, &len, ref, src, ctx);
+  Occurrences are found left to right, and do not overlap; text that
+  has been replaced is not searched again.  The result is built in a
+  single pass, into a new variable-length string:
+
+  <code>
+  struct string *s = string_replace_all("a-b-c", 5, "-", ", ");
+  // s->raw is now "a, b, c"
+  </code>
+
+  To replace several different strings at once, see @replacer_new.
+
+  Returns a new variable-length string on success, or NULL on
+  failure (including when $find is the empty string).
+ */
+struct string* string_replace_all(const char *src, size_t len, const char *find, const char *with)
+{
+	struct string *s;
+	const char *a, *b, *end;
+	size_t flen, wlen;
+
+	assert(src);  // LCOV_EXCL_LINE
+	assert(find); // LCOV_EXCL_LINE
+	assert(with); // LCOV_EXCL_LINE
+
+	flen = strlen(find);
+	wlen = strlen(with);
+	if (flen == 0) { return NULL; }
+
+	s = string_new(NULL, len + 1);
+	if (!s) { return NULL; }
+
+	for (a = src, end = src + len; (b = search_str(a, end - a, find, flen)) != NULL; a = b + flen) {
+		if (string_appendv(s, strview(a, b - a)) != 0
+		 || string_appendv(s, strview(with, wlen)) != 0) {
+			string_free(s);
+			return NULL;
+		}
 	}
-	*buf = '\0';
+	if (string_appendv(s, strview(a, end - a)) != 0) {
+		string_free(s);
+		return NULL;
+	}
+	return s;
+}
 
-	return 0;
+/*****************************************************************/
+
+/**
+  Compare the views $a and $b.
+
+  Bytes are compared as unsigned characters, as with `memcmp(3)`.  If
+  one view is a prefix of the other, the shorter view sorts first.
+
+  Returns an integer less than, equal to, or greater than zero if $a
+  sorts before, is the same as, or sorts after $b.
+ */
+int strview_cmp(struct strview a, struct strview b)
+{
+	int rc = memcmp(a.p, b.p, a.len < b.len ? a.len : b.len);
+	if (rc != 0) { return rc; }
+	return a.len < b.len ? -1 : (a.len > b.len ? 1 : 0);
+}
+
+/**
+  Check if $a and $b view the same bytes.
+
+  Returns non-zero if they do, and 0 if they do not.
+ */
+int strview_eq(struct strview a, struct strview b)
+{
+	return a.len == b.len && memcmp(a.p, b.p, a.len) == 0;
+}
+
+/**
+  Calculate the hash value of the bytes viewed by $v.
+
+  This is the same djb2 hash used by @H64 (which is the lowest six bits
+  of it), so `strview_hash(strview_cstr(s)) & 0x3f == H64(s)`.
+ */
+unsigned int strview_hash(struct strview v)
+{
+	unsigned int h = 81;
+	const unsigned char *c = (const unsigned char*)v.p;
+	size_t n;
+
+	for (n = v.len; n > 0; n--, c++)
+		h = ((h << 5) + h) + *c;
+
+	return h;
+}
+
+/**
+  Find the first occurrence of $c in $v.
+
+  Returns a pointer to the matching byte, or NULL if $c is not found.
+ */
+const char* strview_chr(struct strview v, char c)
+{
+	return search_byte(v.p, v.len, c);
+}
+
+/**
+  Find the first occurrence of $needle in $hay.
+
+  An empty $needle is found at the start of $hay.
+
+  Returns a pointer to the start of the match inside of $hay,
+  or NULL if $needle is not found.
+ */
+const char* strview_find(struct strview hay, struct strview needle)
+{
+	return search_str(hay.p, hay.len, needle.p, needle.len);
+}
+
+/**
+  Copy the bytes viewed by $v into a new C string.
+
+  Returns a dynamically-allocated, NULL-terminated string that must
+  be freed by the caller, or NULL on failure.
+ */
+char* strview_dup(struct strview v)
+{
+	char *s = malloc(v.len + 1);
+	if (!s) { return NULL; }
+
+	memcpy(s, v.p, v.len);
+	s[v.len] = '\0';
+	return s;
+}
+
+/*****************************************************************/
+
+/**
+  Create a new, empty string table for interning strings.
+
+  Interning a string (via @strtab_intern) stores exactly one copy of
+  each distinct string in the table, and always hands back a pointer
+  to that same copy.  Interned strings can therefore be compared for
+  equality by comparing their pointers, and repeated strings only
+  take up memory once.
+
+  <code>
+  struct strtab *tab = strtab_new();
+  const char *a = strtab_intern(tab, "content-type");
+  const char *b = strtab_intern(tab, header_name);
+
+  if (a == b) {
+      // header_name is "content-type"
+  }
+
+  strtab_free(tab);
+  </code>
+
+  Interned strings also remember their length and hash value, which
+  can be retrieved in constant time with @intern_len and @intern_hash.
+
+  On success, returns a pointer to the new table, which must be freed
+  with @strtab_free.  On failure, returns NULL.
+ */
+struct strtab* strtab_new(void)
+{
+	struct strtab *tab = calloc(1, sizeof(struct strtab));
+	if (!tab) { return NULL; }
+
+	if (_strset_init(&tab->set, 0) != 0) {
+		free(tab);
+		return NULL;
+	}
+	return tab;
+}
+
+/**
+  Free string table $tab, and every string interned in it.
+
+  Any pointers handed out by @strtab_intern become invalid, so
+  anything that holds on to interned strings (like the hashes from
+  @hash_new_interned and stringlists from @stringlist_new_interned)
+  must be freed first.
+ */
+void strtab_free(struct strtab *tab)
+{
+	size_t i;
+
+	if (tab) {
+		for (i = 0; i <= tab->set.mask; i++) {
+			if (tab->set.slots[i].s) {
+				free(_istr_of(tab->set.slots[i].s));
+			}
+		}
+		_strset_free(&tab->set);
+	}
+	free(tab);
+}
+
+/**
+  Intern the bytes viewed by $v in $tab.
+
+  If an identical string has already been interned, it is returned
+  and nothing is copied.  Otherwise, a NULL-terminated copy of $v is
+  added to $tab and returned.
+
+  The returned pointer belongs to $tab, and must not be modified
+  or freed.
+
+  On success, returns the canonical copy of $v.  On failure,
+  returns NULL.
+ */
+const char* strtab_internv(struct strtab *tab, struct strview v)
+{
+	assert(tab); // LCOV_EXCL_LINE
+
+	struct _strent *e;
+	struct _istr *is;
+	unsigned int h = strview_hash(v);
+
+	if (_strset_reserve(&tab->set, 1) != 0) {
+		return NULL;
+	}
+
+	e = _strset_slot(&tab->set, v, h);
+	if (e->s) {
+		return e->s;
+	}
+
+	is = malloc(sizeof(struct _istr) + v.len + 1);
+	if (!is) { return NULL; }
+
+	is->len  = v.len;
+	is->hash = h;
+	memcpy(is->str, v.p, v.len);
+	is->str[v.len] = '\0';
+
+	e->s    = is->str;
+	e->len  = v.len;
+	e->hash = h;
+	tab->set.num++;
+	return is->str;
+}
+
+/**
+  Intern the NULL-terminated string $s in $tab.
+
+  See @strtab_internv.
+ */
+const char* strtab_intern(struct strtab *tab, const char *s)
+{
+	assert(s); // LCOV_EXCL_LINE
+	return strtab_internv(tab, strview_cstr(s));
+}
+
+/**
+  Look up $s in $tab, without interning it.
+
+  Returns the canonical copy of $s if it has been interned in $tab,
+  or NULL if it has not.
+ */
+const char* strtab_lookup(const struct strtab *tab, const char *s)
+{
+	assert(s); // LCOV_EXCL_LINE
+	return strtab_lookupv(tab, strview_cstr(s));
+}
+
+/**
+  Look up the bytes viewed by $v in $tab, without interning them.
+
+  See @strtab_lookup.
+ */
+const char* strtab_lookupv(const struct strtab *tab, struct strview v)
+{
+	assert(tab); // LCOV_EXCL_LINE
+	return _strset_slot(&tab->set, v, strview_hash(v))->s;
+}
+
+/**
+  Get the length of interned string $s.
+
+  $s must have been returned by @strtab_intern (or @strtab_internv).
+ */
+size_t intern_len(const char *s)
+{
+	return _istr_of(s)->len;
+}
+
+/**
+  Get the hash value of interned string $s.
+
+  This is the value @strview_hash calculated when $s was first interned.
+  $s must have been returned by @strtab_intern (or @strtab_internv).
+ */
+unsigned int intern_hash(const char *s)
+{
+	return _istr_of(s)->hash;
 }
 
 /*****************************************************************/
 
+/* Load (up to) 8 bytes of $s as a big-endian integer, stopping at the NULL. */
+static uint64_t _sk_load(const char *s)
+{
+	uint64_t k = 0;
+	int i;
+
+	for (i = 0; i < 8 && s[i]; i++) {
+		k |= (uint64_t)(unsigned char)s[i] << (56 - 8 * i);
+	}
+	return k;
+}
+
+/* Compare two keys (in strcmp order), given that their first $d bytes match. */
+static int _sk_cmp(const struct _skey *a, const struct _skey *b, size_t d)
+{
+	if (a->pfx != b->pfx) {
+		return a->pfx < b->pfx ? -1 : 1;
+	}
+	/* a zero low byte means the strings ended inside the prefix */
+	return (a->pfx & 0xff) ? strcmp(a->s + d + 8, b->s + d + 8) : 0;
+}
+
+static void _sk_isort(struct _skey *k, size_t n, size_t d)
+{
+	struct _skey t;
+	size_t i, j;
+
+	for (i = 1; i < n; i++) {
+		t = k[i];
+		for (j = i; j > 0 && _sk_cmp(&t, &k[j - 1], d) < 0; j--) {
+			k[j] = k[j - 1];
+		}
+		k[j] = t;
+	}
+}
+
+static uint64_t _sk_median(uint64_t a, uint64_t b, uint64_t c)
+{
+	if (a < b) { return b < c ? b : (a < c ? c : a); }
+	else       { return a < c ? a : (b < c ? c : b); }
+}
+
+/*
+  Multikey quicksort: a 3-way quicksort on the 8-byte prefix of each
+  string at depth $d, where the strings whose prefixes tie with the
+  pivot then get sorted on their next 8 bytes.  Bytes that have
+  already been compared are never compared again, and most of the
+  comparisons are between integers cached alongside the pointers,
+  instead of strcmp(3) calls on memory all over the heap.
+ */
+static void _sl_msort(struct _skey *k, size_t n, size_t d)
+{
+	struct _skey t;
+	uint64_t p;
+	size_t i, lt, gt, eq, nd;
+
+	while (n > MSORT_CUTOFF) {
+		p = _sk_median(k[0].pfx, k[n / 2].pfx, k[n - 1].pfx);
+		for (lt = i = 0, gt = n; i < gt; ) {
+			if (k[i].pfx < p) {
+				t = k[lt]; k[lt++] = k[i]; k[i++] = t;
+			} else if (k[i].pfx > p) {
+				t = k[--gt]; k[gt] = k[i]; k[i] = t;
+			} else {
+				i++;
+			}
+		}
+
+		/* the middle partition moves on to the next 8 bytes,
+		   unless those strings have all ended (and are equal) */
+		eq = (p & 0xff) ? gt - lt : 0;
+		nd = d + 8;
+		for (i = 0; i < eq; i++) {
+			k[lt + i].pfx = _sk_load(k[lt + i].s + nd);
+		}
+
+		/* recurse into the two smaller partitions, and loop on the
+		   biggest, to keep the stack shallow */
+		if (lt >= eq && lt >= n - gt) {
+			_sl_msort(k + lt, eq, nd);
+			_sl_msort(k + gt, n - gt, d);
+			n = lt;
+		} else if (n - gt >= eq) {
+			_sl_msort(k, lt, d);
+			_sl_msort(k + lt, eq, nd);
+			k += gt; n -= gt;
+		} else {
+			_sl_msort(k, lt, d);
+			_sl_msort(k + gt, n - gt, d);
+			k += lt; n = eq; d = nd;
+		}
+	}
+	_sk_isort(k, n, d);
+}
+
+/* Sort the $n strings at $v in STRINGLIST_SORT_ASC order,
+   returning non-zero if it couldn't. */
+static int _sl_sort_strings(char **v, size_t n)
+{
+	struct _skey *k;
+	size_t i;
+
+	if (!(k = malloc(n * sizeof(struct _skey)))) { return -1; }
+	for (i = 0; i < n; i++) {
+		k[i].s   = v[i];
+		k[i].pfx = _sk_load(k[i].s);
+	}
+
+	_sl_msort(k, n, 0);
+
+	for (i = 0; i < n; i++) {
+		v[i] = k[i].s;
+	}
+	free(k);
+	return 0;
+}
+
+/* Reverse the order of the $n strings at $v. */
+static void _sl_reverse(char **v, size_t n)
+{
+	char *t;
+	size_t i, j;
+
+	for (i = 0, j = n; i + 1 < j; i++, j--) {
+		t = v[i];
+		v[i] = v[j - 1];
+		v[j - 1] = t;
+	}
+}
+
+/* Sort the $n strings at $v, the way stringlist_sort() does. */
+static void _sl_sort_range(char **v, size_t n, sl_comparator cmp)
+{
+	if (n < 2) { return; }
+
+	if ((cmp != STRINGLIST_SORT_ASC && cmp != STRINGLIST_SORT_DESC)
+	 || _sl_sort_strings(v, n) != 0) {
+		qsort(v, n, sizeof(char *), cmp);
+
+	} else if (cmp == STRINGLIST_SORT_DESC) {
+		_sl_reverse(v, n);
+	}
+}
+
 int STRINGLIST_SORT_ASC(const void *a, const void *b)
 {
 	/* params are pointers to char* */
@@ -408,6 +1648,11 @@ int STRINGLIST_SORT_DESC(const void *a, const void *b)
   freed and the NULL will be returned.
  */
 struct stringlist* stringlist_new(char **src)
+{
+	return stringlist_new_interned(src, NULL);
+}
+
+static struct stringlist* _sl_new(char **src, struct strtab *tab, unsigned int flags)
 {
 	struct stringlist *sl;
 	char **t;
@@ -425,6 +1670,8 @@ struct stringlist* stringlist_new(char **src)
 		sl->num = 0;
 		sl->len = INIT_LEN;
 	}
+	sl->strtab = tab;
+	sl->flags  = tab ? flags & ~SL_ARENA : flags;
 
 	sl->strings = calloc(sl->len, sizeof(char *));
 	if (!sl->strings) {
@@ -432,15 +1679,65 @@ struct stringlist* stringlist_new(char **src)
 		return NULL;
 	}
 
+	if ((sl->flags & SL_ARENA) && sl->num
+	 && _sl_reserve_bytes(sl, _sl_bytes(src, sl->num)) != 0) {
+		free(sl->strings);
+		free(sl);
+		return NULL;
+	}
+
 	if (src) {
 		for (t = sl->strings; *src; src++, t++) {
-			*t = strdup(*src);
+			*t = _sl_strdup(sl, strview_cstr(*src));
 		}
 	}
 
 	return sl;
 }
 
+/**
+  Create a new String List, of strings interned in $tab.
+
+  This works just like @stringlist_new, except that instead of
+  keeping its own copy of each string, the list stores the canonical
+  pointers from @strtab_intern.  Adding a string that has already
+  been interned in $tab costs a table lookup instead of a `strdup(3)`,
+  and adding strings that were themselves returned by @strtab_intern
+  copies nothing.
+
+  The strings belong to $tab, and it must outlive the list.
+  Strings removed from the list stay in $tab.
+
+  If $tab is NULL, this is the same as @stringlist_new.
+ */
+struct stringlist* stringlist_new_interned(char **src, struct strtab *tab)
+{
+	return _sl_new(src, tab, 0);
+}
+
+/**
+  Create a new String List, with arena storage.
+
+  This works just like @stringlist_new, except that the list copies
+  its strings into a few large blocks of memory that it owns, instead
+  of allocating each one separately.  Adding a string is then little
+  more than a `memcpy(3)`, and @stringlist_free releases all of the
+  strings with a handful of calls to `free(3)`.
+
+  Strings removed from an arena-backed list are not reclaimed until
+  the list itself is freed, and the strings in the list must never
+  be passed to `free(3)` directly.
+
+  @stringlist_split returns an arena-backed list when asked to (with
+  `SPLIT_ARENA`), and @stringlist_dup does when it duplicates one.
+
+  On success, returns a new string list.  On failure, returns NULL.
+ */
+struct stringlist* stringlist_new_arena(char **src)
+{
+	return _sl_new(src, NULL, SL_ARENA);
+}
+
 /**
   Duplicate $orig.
 
@@ -457,12 +1754,18 @@ struct stringlist* stringlist_new(char **src)
   struct stringlist *new2 = stringlist_new(orig->strings);
   </code>
 
+  The duplicate stores its strings the same way $orig does: if $orig
+  is arena-backed (see @stringlist_new_arena), the duplicate keeps its
+  strings in a single arena block, and if $orig holds interned strings
+  (see @stringlist_new_interned), so will the duplicate, from the same
+  string table.  Otherwise, each string is a separate copy.
+
   On success, a new stringlist that is equivalent to $orig
   is returned.  On failure, NULL is returned.
  */
 struct stringlist* stringlist_dup(struct stringlist *orig)
 {
-	return stringlist_new(orig->strings);
+	return _sl_new(orig->strings, orig->strtab, orig->flags & (SL_ARENA | SL_SORTED));
 }
 
 /**
@@ -470,10 +1773,25 @@ struct stringlist* stringlist_dup(struct stringlist *orig)
  */
 void stringlist_free(struct stringlist *sl)
 {
+	struct sl_block *b;
 	size_t i;
 	if (sl) {
-		for_each_string(sl,i) {
-			free(sl->strings[i]);
+		_sl_index_free(sl->index);
+		sl->index = NULL;
+
+		if (sl->flags & SL_ARENA) {
+			while ((b = sl->blocks) != NULL) {
+				sl->blocks = b->next;
+				free(b);
+			}
+			if (sl->map) {
+				munmap(sl->map->addr, sl->map->len);
+				free(sl->map);
+			}
+		} else {
+			for_each_string(sl,i) {
+				_sl_release(sl, sl->strings[i]);
+			}
 		}
 		free(sl->strings);
 	}
@@ -492,7 +1810,15 @@ void stringlist_free(struct stringlist *sl)
 
   Two basic comparators are defined already: `STRINGLIST_SORT_ASC` and
   `STRINGLIST_SORT_DESC` for sorting alphabetically and reverse alphabetically,
-  respectively.
+  respectively.  Given either of these, the list is not handed to `qsort(3)`,
+  but sorted with a string-specific algorithm (a multikey quicksort) that
+  gives the same order, and that is much faster, especially for strings
+  that share long prefixes (like paths).
+
+  A list sorted with `STRINGLIST_SORT_ASC` remembers that it is sorted,
+  until something is added out of order, so that @stringlist_search
+  can use a binary search.  If you rearrange `$sl->strings` yourself,
+  sort the list again before searching it.
 
   **Note:** Sorting is done in-place; $sl *will* be modified.
  */
@@ -501,8 +1827,184 @@ void stringlist_sort(struct stringlist *sl, sl_comparator cmp)
 	assert(sl);  // LCOV_EXCL_LINE
 	assert(cmp); // LCOV_EXCL_LINE
 
-	if (sl->num < 2) { return; }
-	qsort(sl->strings, sl->num, sizeof(char *), cmp);
+	sl->flags &= ~SL_SORTED;
+	_sl_sort_range(sl->strings, sl->num, cmp);
+	if (cmp == STRINGLIST_SORT_ASC) {
+		sl->flags |= SL_SORTED;
+	}
+}
+
+static void* _psort_worker(void *udata)
+{
+	struct _psort *t = (struct _psort*)udata;
+	size_t i, j, end_a, end_b;
+	char **out;
+
+	if (!t->b) {
+		_sl_sort_range(t->a, t->na, t->cmp);
+		return NULL;
+	}
+
+	/* merge; ties go to $a, which came first */
+	out = t->out;
+	end_a = t->na; end_b = t->nb;
+	for (i = j = 0; i < end_a && j < end_b; ) {
+		if (t->cmp(&t->a[i], &t->b[j]) <= 0) {
+			*out++ = t->a[i++];
+		} else {
+			*out++ = t->b[j++];
+		}
+	}
+	memcpy(out, t->a + i, (end_a - i) * sizeof(char *));
+	out += end_a - i;
+	memcpy(out, t->b + j, (end_b - j) * sizeof(char *));
+	return NULL;
+}
+
+/* Run each of the $n tasks in its own thread (or in this one, if need be). */
+static void _psort_run(struct _psort *tasks, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		tasks[i].started = i > 0 && pthread_create(&tasks[i].tid, NULL, _psort_worker, &tasks[i]) == 0;
+	}
+	_psort_worker(&tasks[0]);
+	for (i = 1; i < n; i++) {
+		if (tasks[i].started) {
+			pthread_join(tasks[i].tid, NULL);
+		} else {
+			_psort_worker(&tasks[i]);
+		}
+	}
+}
+
+/* First position in the $n sorted strings at $v that does not sort before $s. */
+static size_t _psort_lower(char **v, size_t n, char *s, sl_comparator cmp)
+{
+	size_t lo = 0, hi = n, mid;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cmp(&v[mid], &s) < 0) { lo = mid + 1; } else { hi = mid; }
+	}
+	return lo;
+}
+
+/**
+  Sort $sl, using $cmp to compare strings, with up to $nthreads threads.
+
+  The list is cut into $nthreads pieces, which are sorted at the same
+  time, in different threads, exactly as @stringlist_sort would sort them.
+  The sorted pieces are then merged together, pairwise, with each merge
+  itself split up among the threads.  The end result is the same order
+  that @stringlist_sort produces.
+
+  If $nthreads is zero (or negative), one thread per online CPU is used.
+  Lists that are too small to benefit (fewer than about 64k strings
+  per thread) are sorted by @stringlist_sort, in the calling thread.
+
+  **Note:** Sorting is done in-place; $sl *will* be modified.
+
+  On success, returns 0.  On failure, returns non-zero, and $sl is
+  sorted anyway, by @stringlist_sort.
+ */
+int stringlist_sort_parallel(struct stringlist *sl, sl_comparator cmp, int nthreads)
+{
+	assert(sl);  // LCOV_EXCL_LINE
+	assert(cmp); // LCOV_EXCL_LINE
+
+	struct _psort *tasks;
+	char **src, **dst, **tmp;
+	size_t nruns, *runs, i, j, r, w, per, ai, bi, na, nb, lo, hi;
+	long ncpu;
+
+	if (nthreads <= 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (int)ncpu : 1;
+	}
+	if ((size_t)nthreads > sl->num / PSORT_MIN) {
+		nthreads = sl->num / PSORT_MIN;
+	}
+	if (nthreads < 2) {
+		stringlist_sort(sl, cmp);
+		return 0;
+	}
+
+	tasks = calloc(nthreads, sizeof(struct _psort));
+	runs  = calloc(nthreads + 1, sizeof(size_t));
+	tmp   = malloc(sl->num * sizeof(char *));
+	if (!tasks || !runs || !tmp) {
+		free(tasks); free(runs); free(tmp);
+		stringlist_sort(sl, cmp);
+		return -1;
+	}
+
+	/* sort $nthreads runs, in place */
+	sl->flags &= ~SL_SORTED;
+	nruns = nthreads;
+	for (i = 0; i <= nruns; i++) {
+		runs[i] = sl->num * i / nruns;
+	}
+	for (i = 0; i < nruns; i++) {
+		tasks[i].a   = sl->strings + runs[i];
+		tasks[i].na  = runs[i + 1] - runs[i];
+		tasks[i].b   = NULL;
+		tasks[i].cmp = cmp;
+	}
+	_psort_run(tasks, nruns);
+
+	/* merge pairs of runs, back and forth between the list and $tmp,
+	   until there is only one; each merge of a pair is split into
+	   pieces (at points found by binary search), one per thread */
+	src = sl->strings; dst = tmp;
+	while (nruns > 1) {
+		per = nthreads / (nruns / 2);
+		for (w = r = 0; r + 1 < nruns; r += 2) {
+			na = runs[r + 1] - runs[r];
+			nb = runs[r + 2] - runs[r + 1];
+			for (j = 0; j < per; j++, w++) {
+				ai = na * j / per;
+				lo = j == 0 ? 0 : _psort_lower(src + runs[r + 1], nb, src[runs[r] + ai], cmp);
+				hi = j + 1 == per ? nb : _psort_lower(src + runs[r + 1], nb, src[runs[r] + na * (j + 1) / per], cmp);
+				bi = na * (j + 1) / per;
+
+				tasks[w].a   = src + runs[r] + ai;
+				tasks[w].na  = bi - ai;
+				tasks[w].b   = src + runs[r + 1] + lo;
+				tasks[w].nb  = hi - lo;
+				tasks[w].out = dst + runs[r] + ai + lo;
+				tasks[w].cmp = cmp;
+			}
+		}
+		if (nruns % 2) {
+			/* odd run out; carry it over as-is */
+			memcpy(dst + runs[nruns - 1], src + runs[nruns - 1],
+			       (runs[nruns] - runs[nruns - 1]) * sizeof(char *));
+		}
+		_psort_run(tasks, w);
+
+		for (i = 0, j = 0; j <= nruns; i++, j += 2) {
+			runs[i] = runs[j];
+		}
+		nruns = (nruns + 1) / 2;
+		runs[nruns] = sl->num;
+
+		tmp = src; src = dst; dst = tmp;
+	}
+
+	if (src != sl->strings) {
+		memcpy(sl->strings, src, sl->num * sizeof(char *));
+		free(src);
+	} else {
+		free(dst);
+	}
+	free(tasks);
+	free(runs);
+
+	if (cmp == STRINGLIST_SORT_ASC) {
+		sl->flags |= SL_SORTED;
+	}
+	return 0;
 }
 
 /**
@@ -517,77 +2019,304 @@ void stringlist_sort(struct stringlist *sl, sl_comparator cmp)
   <code>
   struct stringlist *fruit = stringlist_new(NULL);
 
-  stringlist_add(fruit, "pear");
-  stringlist_add(fruit, "banana");
-  stringlist_add(fruit, "pear");
-  stringlist_add(fruit, "apple");
-  stringlist_add(fruit, "pear");
+  stringlist_add(fruit, "pear");
+  stringlist_add(fruit, "banana");
+  stringlist_add(fruit, "pear");
+  stringlist_add(fruit, "apple");
+  stringlist_add(fruit, "pear");
+
+  // at this point, the list is 'pear', 'banana', 'pear', 'apple', 'pear'
+
+  stringlist_uniq(fruit);
+
+  // now, the list is 'apple', 'banana', 'pear'
+  </code>
+
+  **Note:** De-duplication is done in-place; $sl *will* be modified.
+ */
+void stringlist_uniq(struct stringlist *sl)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	size_t i;
+
+	if (sl->num < 2) { return; }
+
+	stringlist_sort(sl, STRINGLIST_SORT_ASC);
+	for (i = 0; i < sl->num - 1; i++) {
+		if (strcmp(sl->strings[i], sl->strings[i+1]) == 0) {
+			_sl_release(sl, sl->strings[i]);
+			sl->strings[i] = NULL;
+		}
+	}
+	_sl_reduce(sl);
+}
+
+/**
+  Remove duplicate strings from $sl, without sorting it.
+
+  Unlike @stringlist_uniq, this keeps the first occurrence of each
+  string where it was, in the original order, and only removes later
+  copies.  Duplicates are found by hashing each string once, so this
+  runs in (expected) linear time, instead of sorting the list first.
+
+  <code>
+  // list is 'pear', 'banana', 'pear', 'apple', 'banana'
+  stringlist_dedup(list);
+  // now, the list is 'pear', 'banana', 'apple'
+  </code>
+
+  **Note:** De-duplication is done in-place; $sl *will* be modified.
+
+  On success, returns 0.  On failure, returns non-zero and $sl is
+  left unmodified.
+ */
+int stringlist_dedup(struct stringlist *sl)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	struct _strset seen;
+	struct _strent *e;
+	struct strview v;
+	unsigned int h;
+	size_t i;
+	int removed = 0;
+
+	if (sl->num < 2) { return 0; }
+	if (_strset_init(&seen, sl->num) != 0) { return -1; }
+
+	for_each_string(sl,i) {
+		v = strview_cstr(sl->strings[i]);
+		h = strview_hash(v);
+		e = _strset_slot(&seen, v, h);
+		if (e->s) {
+			_sl_release(sl, sl->strings[i]);
+			sl->strings[i] = NULL;
+			removed = 1;
+			continue;
+		}
+
+		e->s    = v.p;
+		e->len  = v.len;
+		e->hash = h;
+		seen.num++;
+	}
+
+	_strset_free(&seen);
+	return removed ? _sl_reduce(sl) : 0;
+}
+
+/**
+  Look for $needle in $sl.
+
+  If $sl has an index (see @stringlist_index), the index is consulted
+  instead of the list.  If $sl is known to be sorted (by @stringlist_sort
+  with `STRINGLIST_SORT_ASC`, or by @stringlist_uniq), it is binary
+  searched.  Otherwise, each string is compared in turn.
+
+  If $needle is found in $list, returns 0.
+  Otherwise, returns non-zero.
+ */
+int stringlist_search(const struct stringlist *sl, const char* needle)
+{
+	assert(sl);     // LCOV_EXCL_LINE
+	assert(needle); // LCOV_EXCL_LINE
+
+	struct strview v;
+	struct _strent *e;
+	size_t i, lo, hi;
+	int c;
+
+	if (sl->index) {
+		v = strview_cstr(needle);
+		e = _strset_slot(&sl->index->set, v, strview_hash(v));
+		return e->s ? 0 : -1;
+	}
+
+	if (sl->flags & SL_SORTED) {
+		for (lo = 0, hi = sl->num; lo < hi; ) {
+			i = lo + (hi - lo) / 2;
+			c = strcmp(sl->strings[i], needle);
+			if (c == 0) { return 0; }
+			if (c < 0) { lo = i + 1; } else { hi = i; }
+		}
+		return -1;
+	}
+
+	for_each_string(sl,i) {
+		if (sl->strings[i] == needle || strcmp(sl->strings[i], needle) == 0) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+  Attach a membership index to $sl.
+
+  An indexed list keeps a hash set of its strings up to date as
+  strings are added and removed (via the stringlist_* functions), so
+  that @stringlist_search takes constant time, even if the list is
+  not sorted.  The index costs a copy of each distinct string.
+
+  Building an index for a list that already has one does nothing.
+  The index is freed along with the list, or by @stringlist_unindex.
+
+  On success, returns 0.  On failure, returns non-zero.
+ */
+int stringlist_index(struct stringlist *sl)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	struct sl_index *idx;
+	size_t i;
+
+	if (sl->index) { return 0; }
+
+	idx = calloc(1, sizeof(struct sl_index));
+	if (!idx || _strset_init(&idx->set, sl->num) != 0) {
+		free(idx);
+		return -1;
+	}
+
+	for_each_string(sl,i) {
+		if (_sl_index_add(idx, strview_cstr(sl->strings[i])) != 0) {
+			_sl_index_free(idx);
+			return -1;
+		}
+	}
+
+	sl->index = idx;
+	return 0;
+}
+
+/**
+  Detach and free the membership index of $sl, if it has one.
+
+  See @stringlist_index.
+ */
+void stringlist_unindex(struct stringlist *sl)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	_sl_index_free(sl->index);
+	sl->index = NULL;
+}
+
+/**
+  Append a copy of $str to $sl.
+
+  On success, returns 0.  On failure, returns non-zero.
+ */
+int stringlist_add(struct stringlist *sl, const char* str)
+{
+	assert(sl);  // LCOV_EXCL_LINE
+	assert(str); // LCOV_EXCL_LINE
 
-  // at this point, the list is 'pear', 'banana', 'pear', 'apple', 'pear'
+	return stringlist_addv(sl, strview_cstr(str));
+}
 
-  stringlist_uniq(fruit);
+/**
+  Append a copy of the bytes viewed by $v to $sl.
 
-  // now, the list is 'apple', 'banana', 'pear'
-  </code>
+  This is the same as @stringlist_add, except that the value
+  does not need to be NULL-terminated; the copy stored in $sl will be.
 
-  **Note:** De-duplication is done in-place; $sl *will* be modified.
+  On success, returns 0.  On failure, returns non-zero.
  */
-void stringlist_uniq(struct stringlist *sl)
+int stringlist_addv(struct stringlist *sl, struct strview v)
 {
-	assert(sl); // LCOV_EXCL_LINE
+	assert(sl);  // LCOV_EXCL_LINE
+	assert(v.p); // LCOV_EXCL_LINE
 
-	size_t i;
+	char *s;
 
-	if (sl->num < 2) { return; }
+	/* expand as needed */
+	if (_sl_capacity(sl) == 0 && _sl_expand(sl, 1) != 0) {
+		return -1;
+	}
+	if (!(s = _sl_strdup(sl, v))) {
+		return -1;
+	}
 
-	stringlist_sort(sl, STRINGLIST_SORT_ASC);
-	for (i = 0; i < sl->num - 1; i++) {
-		if (strcmp(sl->strings[i], sl->strings[i+1]) == 0) {
-			free(sl->strings[i]);
-			sl->strings[i] = NULL;
-		}
+	if ((sl->flags & SL_SORTED) && sl->num > 0
+	 && strcmp(sl->strings[sl->num - 1], s) > 0) {
+		sl->flags &= ~SL_SORTED;
 	}
-	_sl_reduce(sl);
+	sl->strings[sl->num++] = s;
+	sl->strings[sl->num] = NULL;
+
+	return 0;
 }
 
 /**
-  Look for $needle in $sl.
+  Make room in $sl for at least $n more strings.
 
-  If $needle is found in $list, returns 0.
-  Otherwise, returns non-zero.
+  Stringlists grow automatically as strings are added, but if you
+  know ahead of time how many strings are coming (say, the number of
+  rows in a result set), reserving room for all of them up front
+  means that the list will not need to grow again until they have
+  all been added.
+
+  On success, returns 0.  On failure, returns non-zero and $sl is
+  unmodified.
  */
-int stringlist_search(const struct stringlist *sl, const char* needle)
+int stringlist_reserve(struct stringlist *sl, size_t n)
 {
-	assert(sl);     // LCOV_EXCL_LINE
-	assert(needle); // LCOV_EXCL_LINE
+	assert(sl); // LCOV_EXCL_LINE
 
-	size_t i;
-	for_each_string(sl,i) {
-		if ( strcmp(sl->strings[i], needle) == 0 ) {
-			return 0;
-		}
-	}
-	return -1;
+	size_t have = _sl_capacity(sl);
+	if (have >= n) { return 0; }
+	return _sl_expand(sl, n - have);
 }
 
 /**
-  Append a copy of $str to $sl.
+  Append copies of the $n strings at $strs to $sl.
 
-  On success, returns 0.  On failure, returns non-zero.
+  This works like calling @stringlist_add $n times, except that the
+  list is grown (at most) once, and if $sl is arena-backed (see
+  @stringlist_new_arena), room for all of the strings is set aside in
+  its arena at the same time, so they are all copied in one pass.
+
+  On success, returns 0.  On failure, returns non-zero and $sl is
+  unmodified.
  */
-int stringlist_add(struct stringlist *sl, const char* str)
+int stringlist_add_n(struct stringlist *sl, char **strs, size_t n)
 {
-	assert(sl);  // LCOV_EXCL_LINE
-	assert(str); // LCOV_EXCL_LINE
+	assert(sl);           // LCOV_EXCL_LINE
+	assert(strs || !n);   // LCOV_EXCL_LINE
 
-	/* expand as needed */
-	if (_sl_capacity(sl) == 0 && _sl_expand(sl, 1) != 0) {
+	size_t i;
+	char *s;
+
+	if (n == 0) { return 0; }
+	if (stringlist_reserve(sl, n) != 0) {
+		return -1;
+	}
+	if (!sl->strtab && (sl->flags & SL_ARENA)
+	 && _sl_reserve_bytes(sl, _sl_bytes(strs, n)) != 0) {
 		return -1;
 	}
 
-	sl->strings[sl->num++] = strdup(str);
+	for (i = 0; i < n; i++) {
+		if (!(s = _sl_strdup(sl, strview_cstr(strs[i])))) {
+			/* undo, so that $sl is unmodified */
+			while (i-- > 0) {
+				_sl_release(sl, sl->strings[--sl->num]);
+			}
+			sl->strings[sl->num] = NULL;
+			return -1;
+		}
+		sl->strings[sl->num++] = s;
+	}
 	sl->strings[sl->num] = NULL;
 
+	for (i = sl->num - n; (sl->flags & SL_SORTED) && i < sl->num; i++) {
+		if (i > 0 && strcmp(sl->strings[i - 1], sl->strings[i]) > 0) {
+			sl->flags &= ~SL_SORTED;
+		}
+	}
+
 	return 0;
 }
 
@@ -597,6 +2326,9 @@ int stringlist_add(struct stringlist *sl, const char* str)
   The order of arguments can be remembered by envsioning the call
   as a replacement for a simpler one: `$dest += $src`
 
+  This is @stringlist_add_n, for the strings of $src.  $src and $dst
+  may be the same list.
+
   On success, returns 0.  On failure, returns non-zero and $dest is
   unmodified.
  */
@@ -605,17 +2337,110 @@ int stringlist_add_all(struct stringlist *dst, const struct stringlist *src)
 	assert(src); // LCOV_EXCL_LINE
 	assert(dst); // LCOV_EXCL_LINE
 
+	size_t n = src->num;
+
+	/* grow first, so that $src->strings stays put if $src is $dst */
+	if (stringlist_reserve(dst, n) != 0) {
+		return -1;
+	}
+	return stringlist_add_n(dst, src->strings, n);
+}
+
+/**
+  Append $str to $sl, handing it over to the list.
+
+  Unlike @stringlist_add, this does not copy $str; it must have been
+  allocated with `malloc(3)` (or `strdup(3)`, etc.) and, on success,
+  belongs to $sl from then on, which will `free(3)` it when it is
+  removed, or when the list is freed.  This saves an allocation and
+  a copy for callers that build strings just to put them in a list:
+
+  <code>
+  char *s;
+  if (asprintf(&s, "%s/%s", dir, file) > 0
+   && stringlist_adopt(files, s) != 0) {
+      free(s);
+  }
+  </code>
+
+  Lists that do not own their strings one by one (see
+  @stringlist_new_interned and @stringlist_new_arena) still take
+  ownership of $str, but store a copy of it, and free $str right away.
+
+  On success, returns 0.  On failure, returns non-zero; $sl is
+  unmodified and $str still belongs to the caller.
+ */
+int stringlist_adopt(struct stringlist *sl, char *str)
+{
+	assert(sl);  // LCOV_EXCL_LINE
+	assert(str); // LCOV_EXCL_LINE
+
+	return stringlist_adopt_n(sl, &str, 1);
+}
+
+/**
+  Append the $n strings at $strs to $sl, handing them over to the list.
+
+  This is @stringlist_adopt for $n strings at once, and, like
+  @stringlist_add_n, grows the list (at most) once.  Either all of
+  the strings are adopted, or none of them are.
+
+  On success, returns 0.  On failure, returns non-zero; $sl is
+  unmodified and all of the strings still belong to the caller.
+ */
+int stringlist_adopt_n(struct stringlist *sl, char **strs, size_t n)
+{
+	assert(sl);         // LCOV_EXCL_LINE
+	assert(strs || !n); // LCOV_EXCL_LINE
+
+	int copy = sl->strtab || (sl->flags & SL_ARENA);
 	size_t i;
+	char *s;
 
-	if (_sl_capacity(dst) < src->num && _sl_expand(dst, src->num)) {
+	if (n == 0) { return 0; }
+	if (stringlist_reserve(sl, n) != 0) {
+		return -1;
+	}
+	if (copy && !sl->strtab
+	 && _sl_reserve_bytes(sl, _sl_bytes(strs, n)) != 0) {
 		return -1;
 	}
 
-	for_each_string(src,i) {
-		dst->strings[dst->num++] = strdup(src->strings[i]);
+	for (i = 0; i < n; i++) {
+		if (copy) {
+			s = _sl_strdup(sl, strview_cstr(strs[i]));
+		} else if (!sl->index || _sl_index_add(sl->index, strview_cstr(strs[i])) == 0) {
+			s = strs[i];
+		} else {
+			s = NULL;
+		}
+
+		if (!s) {
+			/* undo, without freeing anything that is still the caller's */
+			while (i-- > 0) {
+				s = sl->strings[--sl->num];
+				if (sl->index) {
+					_sl_index_drop(sl->index, s);
+				}
+			}
+			sl->strings[sl->num] = NULL;
+			return -1;
+		}
+		sl->strings[sl->num++] = s;
+	}
+	sl->strings[sl->num] = NULL;
+
+	for (i = sl->num - n; (sl->flags & SL_SORTED) && i < sl->num; i++) {
+		if (i > 0 && strcmp(sl->strings[i - 1], sl->strings[i]) > 0) {
+			sl->flags &= ~SL_SORTED;
+		}
 	}
-	dst->strings[dst->num] = NULL;
 
+	if (copy) {
+		for (i = 0; i < n; i++) {
+			free(strs[i]);
+		}
+	}
 	return 0;
 }
 
@@ -623,13 +2448,16 @@ int stringlist_add_all(struct stringlist *dst, const struct stringlist *src)
   Remove the first occurrence of $str from $sl.
 
   If $value appears in $sl multiple times, multple calls
-  are needed to remove them.  This is best done in a while loop:
+  are needed to remove them:
 
   <code>
   while (stringlist_remove(sl, "a string") == 0)
       ;
   </code>
 
+  Each call shifts the rest of the list down, so for removing many
+  strings from a long list, @stringlist_remove_if is much faster.
+
   If $str was found in, and removed from $sl, returns 0.
   Otherwise, returns non-zero.
  */
@@ -640,6 +2468,11 @@ int stringlist_remove(struct stringlist *sl, const char *str)
 
 	char *removed = NULL;
 	size_t i;
+
+	if (sl->index && stringlist_search(sl, str) != 0) {
+		return -1;
+	}
+
 	for (i = 0; i < sl->num; i++) {
 		if (strcmp(sl->strings[i], str) == 0) {
 			removed = sl->strings[i];
@@ -653,7 +2486,7 @@ int stringlist_remove(struct stringlist *sl, const char *str)
 
 	if (removed) {
 		sl->num--;
-		free(removed);
+		_sl_release(sl, removed);
 		return 0;
 	}
 
@@ -661,14 +2494,116 @@ int stringlist_remove(struct stringlist *sl, const char *str)
 }
 
 /**
-  Remove strings in $src from $est.
+  Remove the string at position $i from $sl, and return it.
+
+  The string is not freed; it belongs to the caller, who must
+  `free(3)` it.  The strings after it move up one place, keeping
+  their order.  Together with @stringlist_adopt, this lets strings
+  move between lists (or out to the rest of the program) without
+  being copied.
+
+  If $sl does not own its strings one by one (see
+  @stringlist_new_interned and @stringlist_new_arena), a copy of
+  the string is returned instead.
+
+  On success, returns the string.  On failure (including if $i is
+  out of range), returns NULL and $sl is unmodified.
+ */
+char* stringlist_take(struct stringlist *sl, size_t i)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	char *s;
+
+	if (i >= sl->num) { return NULL; }
+
+	s = sl->strings[i];
+	if (sl->strtab || (sl->flags & SL_ARENA)) {
+		if (!(s = strdup(s))) { return NULL; }
+	}
+	if (sl->index) {
+		_sl_index_drop(sl->index, sl->strings[i]);
+	}
+
+	memmove(&sl->strings[i], &sl->strings[i+1], (sl->num - i) * sizeof(char *));
+	sl->num--;
+	return s;
+}
+
+/* Drop every string in $sl for which $pred says $drop, in one pass. */
+static size_t _sl_filter(struct stringlist *sl, sl_predicate pred, void *ctx, int drop)
+{
+	size_t i, n;
+
+	for (i = n = 0; i < sl->num; i++) {
+		if ((pred(sl->strings[i], ctx) != 0) == drop) {
+			_sl_release(sl, sl->strings[i]);
+		} else {
+			sl->strings[n++] = sl->strings[i];
+		}
+	}
+	for (i = n; i < sl->num; i++) {
+		sl->strings[i] = NULL;
+	}
+
+	i = sl->num - n;
+	sl->num = n;
+	return i;
+}
+
+/**
+  Remove every string in $sl for which $pred returns non-zero.
+
+  $pred is called once for each string, in order, and is passed
+  the string and $ctx.  The strings that are left keep their order.
+  However many strings are removed, the list is compacted in a
+  single pass, so this takes time proportional to the length of $sl.
+
+  <code>
+  static int is_tmp(const char *s, void *ctx) {
+      return strncmp(s, (const char *)ctx, strlen(ctx)) == 0;
+  }
+
+  // drop all the scratch files
+  stringlist_remove_if(files, is_tmp, "/tmp/");
+  </code>
+
+  Returns the number of strings that were removed.
+ */
+size_t stringlist_remove_if(struct stringlist *sl, sl_predicate pred, void *ctx)
+{
+	assert(sl);   // LCOV_EXCL_LINE
+	assert(pred); // LCOV_EXCL_LINE
+
+	return _sl_filter(sl, pred, ctx, 1);
+}
+
+/**
+  Remove every string in $sl for which $pred returns zero.
+
+  This is the opposite of @stringlist_remove_if; only the strings
+  that $pred accepts are kept.
+
+  Returns the number of strings that were removed.
+ */
+size_t stringlist_retain_if(struct stringlist *sl, sl_predicate pred, void *ctx)
+{
+	assert(sl);   // LCOV_EXCL_LINE
+	assert(pred); // LCOV_EXCL_LINE
+
+	return _sl_filter(sl, pred, ctx, 0);
+}
+
+/**
+  Remove strings in $src from $dst.
 
   The order of the arguments can be remembered by thinking of this
   call as in terms of a simpler one: `$dst -= $src`
 
-  **Note:** this function deals with duplicate values naively,
-  only removing the first such occurrence in $dst for each
-  occurrence in $src.
+  Every occurrence in $dst of a string that appears anywhere in $src
+  is removed; the strings left in $dst keep their order.  To leave
+  $dst alone, and get the result as a new list, use
+  @stringlist_subtract.
 
   <code>
   struct stringlist *list = stringlist_new(NULL);
@@ -681,33 +2616,42 @@ int stringlist_remove(struct stringlist *sl, const char *str)
 
   stringlist_add(rm, "a");
   stringlist_add(rm, "c");
-  stringlist_add(rm, "a");
 
   // list = [ a, b, a, a ]
-  // rm   = [ a, c, a ]
+  // rm   = [ a, c ]
 
   stringlist_remove_all(list, rm);
-  // list - rm = [ a, b ]
+  // list - rm = [ b ]
   </code>
 
-  On success, returns 0.  On failure, returns non-zero.
+  This takes time proportional to the combined length of $dst and
+  $src (see @stringlist_intersect).
+
+  On success, returns 0.  On failure, returns non-zero and $dst is
+  left unmodified.
  */
 int stringlist_remove_all(struct stringlist *dst, struct stringlist *src)
 {
 	assert(src); // LCOV_EXCL_LINE
 	assert(dst); // LCOV_EXCL_LINE
 
-	size_t s, d;
+	size_t d, *count;
+
+	if (dst->num == 0 || src->num == 0) { return 0; }
+	if (!(count = calloc(dst->num, sizeof(size_t)))) { return -1; }
+	if (_sl_counts(dst, src, count) != 0) {
+		free(count);
+		return -1;
+	}
+
 	for_each_string(dst,d) {
-		for_each_string(src,s) {
-			if ( strcmp(dst->strings[d], src->strings[s]) == 0 ) {
-				free(dst->strings[d]);
-				dst->strings[d] = NULL;
-				break;
-			}
+		if (count[d]) {
+			_sl_release(dst, dst->strings[d]);
+			dst->strings[d] = NULL;
 		}
 	}
 
+	free(count);
 	return _sl_reduce(dst);
 }
 
@@ -720,48 +2664,294 @@ int stringlist_remove_all(struct stringlist *dst, struct stringlist *src)
   More rigorously, if X is the set [ l, m, n ] and Y is the set
   [ m, n, o, p ], then the intersection of X and Y is the set [ m, n ].
 
+  Strings appear in the intersection in the order they appear in $a.
+  A string that appears more than once in either list appears in the
+  intersection once for each pairing of an occurrence in $a with an
+  occurrence in $b.
+
+  If both lists are already sorted (i.e. with @stringlist_sort and
+  `STRINGLIST_SORT_ASC`), they are merged together; otherwise the
+  strings of $b are counted in a temporary hash set.  Either way,
+  this takes time proportional to the combined length of the lists.
+
+  The intersection is arena-backed (see @stringlist_new_arena) if $a
+  is; otherwise, each of its strings is a separate copy.
+
   On success, returns a new string list containing strings common to
   $a and $b.  On falure, returns NULL.
  */
 struct stringlist *stringlist_intersect(const struct stringlist *a, const struct stringlist *b)
 {
-	struct stringlist *intersect = stringlist_new(NULL);
-	size_t i, j;
+	assert(a); // LCOV_EXCL_LINE
+	assert(b); // LCOV_EXCL_LINE
+
+	struct stringlist *intersect;
+	size_t i, n, *count;
+
+	if (!(intersect = _sl_new(NULL, NULL, a->flags & SL_ARENA))) { return NULL; }
+	if (a->num == 0 || b->num == 0) { return intersect; }
+
+	if (!(count = calloc(a->num, sizeof(size_t)))
+	 || _sl_counts(a, b, count) != 0) {
+		goto failed;
+	}
+
+	for_each_string(a,i) {
+		for (n = 0; n < count[i]; n++) {
+			if (stringlist_add(intersect, a->strings[i]) != 0) {
+				goto failed;
+			}
+		}
+	}
+
+	free(count);
+	return intersect;
+
+failed:
+	free(count);
+	stringlist_free(intersect);
+	return NULL;
+}
+
+/**
+  Get the union of $a and $b.
+
+  The union of two string lists is a new string list with one copy
+  of each distinct string found in either $a or $b, in the order in
+  which they are first seen (all of $a, then all of $b).
+
+  <code>
+  // a = [ pear, apple, pear ], b = [ fig, apple ]
+  struct stringlist *u = stringlist_union(a, b);
+  // u = [ pear, apple, fig ]
+  </code>
+
+  On success, returns a new string list.  On failure, returns NULL.
+ */
+struct stringlist* stringlist_union(const struct stringlist *a, const struct stringlist *b)
+{
+	assert(a); // LCOV_EXCL_LINE
+	assert(b); // LCOV_EXCL_LINE
+
+	struct stringlist *u;
+
+	if (!(u = stringlist_new_arena(a->strings))) { return NULL; }
+	if (stringlist_add_all(u, b) != 0 || stringlist_dedup(u) != 0) {
+		stringlist_free(u);
+		return NULL;
+	}
+	return u;
+}
+
+/**
+  Get the strings of $a that are not in $b.
+
+  This is the non-destructive version of @stringlist_remove_all;
+  neither $a nor $b is modified.  The strings of $a that remain are
+  kept in order (with any duplicates).
+
+  <code>
+  // a = [ pear, apple, fig, pear ], b = [ apple, kiwi ]
+  struct stringlist *d = stringlist_subtract(a, b);
+  // d = [ pear, fig, pear ]
+  </code>
+
+  This takes time proportional to the combined length of $a and $b
+  (see @stringlist_intersect).
+
+  On success, returns a new string list.  On failure, returns NULL.
+ */
+struct stringlist* stringlist_subtract(const struct stringlist *a, const struct stringlist *b)
+{
+	assert(a); // LCOV_EXCL_LINE
+	assert(b); // LCOV_EXCL_LINE
+
+	struct stringlist *d;
+	size_t i, *count;
+
+	if (!(d = stringlist_new_arena(NULL))) { return NULL; }
+	if (a->num == 0) { return d; }
+
+	if (!(count = calloc(a->num, sizeof(size_t)))
+	 || _sl_counts(a, b, count) != 0) {
+		goto failed;
+	}
+
+	for_each_string(a,i) {
+		if (!count[i] && stringlist_add(d, a->strings[i]) != 0) {
+			goto failed;
+		}
+	}
+
+	free(count);
+	return d;
+
+failed:
+	free(count);
+	stringlist_free(d);
+	return NULL;
+}
+
+/* Does the next string of $a come before the next string of $b? */
+static int _mstream_lt(const struct _mstream *a, const struct _mstream *b)
+{
+	int c = strcmp(*a->v, *b->v);
+	return c < 0 || (c == 0 && a->id < b->id);
+}
+
+/* Sift the stream at $h[i] down into place, in a min-heap of $n streams. */
+static void _merge_sift(struct _mstream *h, size_t n, size_t i)
+{
+	struct _mstream t;
+	size_t c;
+
+	for (t = h[i]; (c = 2 * i + 1) < n; i = c) {
+		if (c + 1 < n && _mstream_lt(&h[c + 1], &h[c])) { c++; }
+		if (!_mstream_lt(&h[c], &t)) { break; }
+		h[i] = h[c];
+	}
+	h[i] = t;
+}
+
+/**
+  Merge the $n sorted stringlists at $lists into a new sorted list.
+
+  Each of the lists must already be in ascending order (i.e. sorted
+  with @stringlist_sort and `STRINGLIST_SORT_ASC`).  They are merged
+  with a heap of the next string from each list, so that combining
+  them costs time proportional to the total number of strings, times
+  the log of $n, instead of the full sort that @stringlist_add_all
+  and @stringlist_sort would need.  Equal strings from different lists
+  come out in the order that their lists appear in $lists.
+
+  If $uniq is non-zero, only one copy of each distinct string is kept,
+  as if @stringlist_uniq had been called on the result.
+
+  <code>
+  // a = [ apple, fig ], b = [ banana, fig, kiwi ]
+  struct stringlist *lists[] = { a, b };
+  struct stringlist *all = stringlist_merge(lists, 2, 1);
+  // all = [ apple, banana, fig, kiwi ]
+  </code>
+
+  If any of the lists is not sorted, they are all concatenated and
+  sorted instead; the result is the same, only slower.
+
+  The result keeps its strings in an arena (see @stringlist_new_arena),
+  and remembers that it is sorted (see @stringlist_search).
+
+  On success, returns a new string list.  On failure, returns NULL.
+ */
+struct stringlist* stringlist_merge(struct stringlist **lists, size_t n, int uniq)
+{
+	assert(lists || n == 0); // LCOV_EXCL_LINE
+
+	struct stringlist *m;
+	struct _mstream *h;
+	size_t i, k, total, bytes;
+	char *s;
+
+	if (!(m = stringlist_new_arena(NULL))) { return NULL; }
+
+	for (total = bytes = i = 0; i < n; i++) {
+		total += lists[i]->num;
+		bytes += _sl_bytes(lists[i]->strings, lists[i]->num);
+	}
+	if (total == 0) {
+		m->flags |= SL_SORTED;
+		return m;
+	}
+	if (stringlist_reserve(m, total) != 0
+	 || _sl_reserve_bytes(m, bytes) != 0) {
+		stringlist_free(m);
+		return NULL;
+	}
 
-	for_each_string(a,i) {
-		for_each_string(b,j) {
-			if (strcmp(a->strings[i], b->strings[j]) == 0) {
-				stringlist_add(intersect, a->strings[i]);
+	for (i = 0; i < n; i++) {
+		if (!_sl_sorted(lists[i])) {
+			/* fall back to the slow way */
+			for (i = 0; i < n; i++) {
+				if (stringlist_add_n(m, lists[i]->strings, lists[i]->num) != 0) {
+					stringlist_free(m);
+					return NULL;
+				}
 			}
+			if (uniq) { stringlist_uniq(m); } else { stringlist_sort(m, STRINGLIST_SORT_ASC); }
+			return m;
 		}
 	}
 
-	return intersect;
+	if (!(h = calloc(n, sizeof(struct _mstream)))) {
+		stringlist_free(m);
+		return NULL;
+	}
+	for (k = i = 0; i < n; i++) {
+		if (lists[i]->num) {
+			h[k].v   = lists[i]->strings;
+			h[k].end = lists[i]->strings + lists[i]->num;
+			h[k].id  = i;
+			k++;
+		}
+	}
+	for (i = k / 2; i-- > 0; ) {
+		_merge_sift(h, k, i);
+	}
+
+	while (k > 0) {
+		s = *h[0].v;
+		if (!uniq || m->num == 0 || strcmp(m->strings[m->num - 1], s) != 0) {
+			m->strings[m->num++] = _sl_arena_dup(m, strview_cstr(s));
+		}
+
+		if (++h[0].v == h[0].end) {
+			h[0] = h[--k];
+		}
+		_merge_sift(h, k, 0);
+	}
+	m->strings[m->num] = NULL;
+	m->flags |= SL_SORTED;
+
+	free(h);
+	return m;
 }
 
 /**
   Compare $a and $b for equivalency.
 
-  If $a and $b contain the same strings, in the same order,
-  returns 0.  Otherwise, the two lists are not equivalent, and
-  non-zero if returned.
+  $a and $b are equivalent if they have the same number of strings,
+  every string in $a is also somewhere in $b, and every string in $b is
+  also somewhere in $a.  Order does not matter.
+
+  This takes time proportional to the combined length of $a and $b
+  (see @stringlist_intersect).
+
+  If $a and $b are equivalent, returns non-zero.  If they differ,
+  returns 0.
  */
 int stringlist_diff(struct stringlist *a, struct stringlist *b)
 {
 	assert(a); // LCOV_EXCL_LINE
 	assert(b); // LCOV_EXCL_LINE
 
-	size_t i;
+	size_t i, *count;
+	int rc = -1; /* equivalent */
 
 	if (a->num != b->num) { return 0; }
-	for_each_string(a,i) {
-		if (stringlist_search(b, a->strings[i]) != 0
-		 || stringlist_search(a, b->strings[i]) != 0) {
-			return 0;
-		}
+	if (a->num == 0) { return rc; }
+	if (!(count = calloc(a->num, sizeof(size_t)))) { return 0; }
+
+	if (_sl_counts(a, b, count) != 0) { rc = 0; }
+	for (i = 0; rc && i < a->num; i++) {
+		if (!count[i]) { rc = 0; }
+	}
+
+	if (rc && _sl_counts(b, a, count) != 0) { rc = 0; }
+	for (i = 0; rc && i < b->num; i++) {
+		if (!count[i]) { rc = 0; }
 	}
 
-	return -1; /* equivalent */
+	free(count);
+	return rc;
 }
 
 /**
@@ -795,20 +2985,25 @@ char* stringlist_join(struct stringlist *list, const char *delim)
 	assert(list);  // LCOV_EXCL_LINE
 	assert(delim); // LCOV_EXCL_LINE
 
-	size_t i, len = 0, delim_len = strlen(delim);
+	size_t i, len, *lens, delim_len = strlen(delim);
 	char *joined, *ptr;
 
 	if (list->num == 0) {
 		return strdup("");
 	}
 
+	/* measure each string once, and remember it for the copy */
+	if (!(lens = malloc(list->num * sizeof(size_t)))) { return NULL; }
+	len = (list->num - 1) * delim_len;
 	for_each_string(list,i) {
-		len += strlen(list->strings[i]);
+		len += lens[i] = strlen(list->strings[i]);
 	}
-	len += (list->num - 1) * delim_len;
 
-	ptr = joined = calloc(len + 1, sizeof(char));
-	if (!ptr) { return NULL; }
+	ptr = joined = malloc(len + 1);
+	if (!ptr) {
+		free(lens);
+		return NULL;
+	}
 
 	for_each_string(list,i) {
 		if (i != 0) {
@@ -816,15 +3011,100 @@ char* stringlist_join(struct stringlist *list, const char *delim)
 			ptr += delim_len;
 		}
 
-		len = strlen(list->strings[i]);
-		memcpy(ptr, list->strings[i], len);
-		ptr += len;
+		memcpy(ptr, list->strings[i], lens[i]);
+		ptr += lens[i];
 	}
 	*ptr = '\0';
 
+	free(lens);
 	return joined;
 }
 
+/**
+  Join strings in $list, separated by $delim, onto the end of $dst.
+
+  This works like @stringlist_join, except that the result is
+  appended to a dynamic string (see @string_new), instead of being
+  returned in a new buffer.  That makes it easy to build up output
+  in pieces, and to reuse one buffer for many joins.
+
+  <code>
+  struct string *s = string_new("colors: ", 0);
+  stringlist_join_into(s, l, ", ");
+  // s->raw is now "colors: red, green, blue"
+  </code>
+
+  $dst is grown (at least) geometrically, so appending many lists
+  to it takes time proportional to the output.
+
+  On success, returns 0.  On failure, returns non-zero and $dst is
+  left unmodified.
+ */
+int stringlist_join_into(struct string *dst, const struct stringlist *list, const char *delim)
+{
+	assert(dst);   // LCOV_EXCL_LINE
+	assert(list);  // LCOV_EXCL_LINE
+	assert(delim); // LCOV_EXCL_LINE
+
+	size_t i, n, need, len = dst->len, delim_len = strlen(delim);
+
+	for_each_string(list,i) {
+		n = strlen(list->strings[i]);
+		need = len + n + (i ? delim_len : 0);
+		if (need >= dst->bytes
+		 && _extend(dst, need > dst->bytes * 2 ? need : dst->bytes * 2) != 0) {
+			/* put back the NULL-terminator we wrote over */
+			dst->raw[dst->len] = '\0';
+			return -1;
+		}
+
+		if (i != 0) {
+			memcpy(dst->raw + len, delim, delim_len);
+			len += delim_len;
+		}
+		memcpy(dst->raw + len, list->strings[i], n);
+		len += n;
+	}
+
+	dst->len = len;
+	dst->p   = dst->raw + len;
+	*dst->p  = '\0';
+	return 0;
+}
+
+/**
+  Join strings in $list, separated by $delim, writing the result to $fd.
+
+  The joined string is never assembled in memory; the strings of
+  $list and the delimiters between them are handed to the kernel in
+  batches, via `writev(2)`, so there is no extra memory needed, no
+  matter how large the result is.
+
+  Short writes and interrupted system calls are retried transparently.
+
+  On success, returns 0.  On failure (i.e. a write error), returns
+  non-zero and `errno` is set appropriately; some of the output may
+  have already been written to $fd.
+ */
+int stringlist_join_fd(int fd, const struct stringlist *list, const char *delim)
+{
+	assert(list);  // LCOV_EXCL_LINE
+	assert(delim); // LCOV_EXCL_LINE
+
+	struct _iob b;
+	size_t i, delim_len = strlen(delim);
+
+	b.fd = fd;
+	b.n  = 0;
+	for_each_string(list,i) {
+		if ((i != 0 && _iob_add(&b, delim, delim_len) != 0)
+		 || _iob_add(&b, list->strings[i], strlen(list->strings[i])) != 0) {
+			return -1;
+		}
+	}
+	return _iob_flush(&b);
+}
+
 /**
   Split $str on $delim and return the result.
 
@@ -839,6 +3119,12 @@ char* stringlist_join(struct stringlist *list, const char *delim)
   - **SPLIT_NORMAL** - Empty tokens are ignored
   - **SPLIT_GREEDY** - Empty tokens are not ignored
 
+  Each token is copied into a string of its own, unless `SPLIT_ARENA`
+  is also set, in which case the tokens are stored in an arena (see
+  @stringlist_new_arena), so that splitting a large buffer does not
+  cost an allocation per token.  The strings of an arena-backed list
+  must not be passed to `free(3)`.
+
   Examples:
 
   <code>
@@ -850,38 +3136,602 @@ char* stringlist_join(struct stringlist *list, const char *delim)
  */
 struct stringlist* stringlist_split(const char *str, size_t len, const char *delim, int opt)
 {
-	struct stringlist *list = stringlist_new(NULL);
-	const char *a, *b, *end = str + len;
-	size_t delim_len = strlen(delim);
-	char *item;
+	struct stringlist *list;
+	struct split_iter it;
+	struct strview tok;
 
-	a = str;
-	while (a < end) {
-		for (b = a; b < end; b++) {
-			if (strncmp(b, delim, delim_len) == 0) {
-				break;
-			}
+	if (!(list = _sl_new(NULL, NULL, opt & SPLIT_ARENA ? SL_ARENA : 0))) { return NULL; }
+
+	split_iter_init(&it, str, len, delim, opt & ~SPLIT_STREAM);
+	while (split_iter_next(&it, &tok)) {
+		if (stringlist_addv(list, tok) != 0) {
+			stringlist_free(list);
+			return NULL;
 		}
+	}
 
-		if (opt != SPLIT_GREEDY || a != b) {
-			item = calloc(b - a + 1, sizeof(char));
-			if (!item) {
-				stringlist_free(list);
-				return NULL;
-			}
-			memcpy(item, a, b - a);
-			item[b-a] = '\0';
+	return list;
+}
+
+/* Split one chunk of the input, in its own thread. */
+static void* _psplit_worker(void *udata)
+{
+	struct _psplit *t = (struct _psplit*)udata;
+	t->out = stringlist_split(t->p, t->len, t->delim, t->opt);
+	return NULL;
+}
+
+/* Can two occurrences of $delim overlap (i.e. "aa" in "aaa")? */
+static int _psplit_overlaps(const char *delim, size_t n)
+{
+	size_t k;
+	for (k = 1; k < n; k++) {
+		if (memcmp(delim, delim + n - k, k) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Move the strings (and arena blocks) of $src onto the end of $dst. */
+static int _sl_splice(struct stringlist *dst, struct stringlist *src)
+{
+	struct sl_block *b;
+
+	if (stringlist_reserve(dst, src->num) != 0) {
+		return -1;
+	}
+	memcpy(dst->strings + dst->num, src->strings, (src->num + 1) * sizeof(char *));
+	dst->num += src->num;
+	src->num = 0;
+	src->strings[0] = NULL;
+
+	if ((b = src->blocks) != NULL) {
+		while (b->next) { b = b->next; }
+		b->next = dst->blocks;
+		dst->blocks = src->blocks;
+		src->blocks = NULL;
+	}
+	return 0;
+}
+
+/**
+  Split $str on $delim, with up to $nthreads threads.
+
+  The result is the same list that @stringlist_split would return,
+  but the work is shared out among several threads.  $str is cut into
+  $nthreads chunks, each of which ends just after an occurrence of
+  $delim, so that no token is cut in two.  Each chunk is split, in
+  its own thread, into a list of its own, and those lists are then
+  stitched together, in order.  The strings themselves are not copied
+  again; they (or, with `SPLIT_ARENA`, the arena blocks that hold them)
+  are handed over to the result.
+
+  If $nthreads is zero (or negative), one thread per online CPU is used.
+  Buffers that are too small to benefit (less than a megabyte or so
+  per thread) are split by @stringlist_split, in the calling thread.
+  So are buffers split on delimiters that can overlap themselves
+  (like "--" in "a---b"), since the chunks could not be cut at the
+  same places that a front-to-back split would find.
+
+  On success, returns a new stringlist.  On failure, returns NULL.
+ */
+struct stringlist* stringlist_split_parallel(const char *str, size_t len, const char *delim, int opt, int nthreads)
+{
+	assert(str);   // LCOV_EXCL_LINE
+	assert(delim); // LCOV_EXCL_LINE
+
+	struct _psplit *tasks;
+	struct stringlist *list = NULL;
+	const char *p, *end, *cut;
+	size_t i, n, delim_len = strlen(delim);
+	long ncpu;
+
+	if (nthreads <= 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (int)ncpu : 1;
+	}
+	if ((size_t)nthreads > len / PSPLIT_MIN) {
+		nthreads = len / PSPLIT_MIN;
+	}
+	if (nthreads < 2 || delim_len == 0 || _psplit_overlaps(delim, delim_len)) {
+		return stringlist_split(str, len, delim, opt);
+	}
+
+	if (!(tasks = calloc(nthreads, sizeof(struct _psplit)))) {
+		return NULL;
+	}
+
+	/* cut the input just past the first delimiter at or after each
+	   of the evenly-spaced points; some chunks may end up empty */
+	end = str + len;
+	for (p = str, n = 0; n < (size_t)nthreads; n++) {
+		cut = end;
+		if (n + 1 < (size_t)nthreads) {
+			cut = str + len * (n + 1) / nthreads;
+			if (cut < p) { cut = p; }
+			cut = search_str(cut, end - cut, delim, delim_len);
+			cut = cut ? cut + delim_len : end;
+		}
+
+		tasks[n].p     = p;
+		tasks[n].len   = cut - p;
+		tasks[n].delim = delim;
+		tasks[n].opt   = opt & ~SPLIT_STREAM;
+		p = cut;
+	}
+
+	for (i = 1; i < n; i++) {
+		tasks[i].started = pthread_create(&tasks[i].tid, NULL, _psplit_worker, &tasks[i]) == 0;
+	}
+	_psplit_worker(&tasks[0]);
+	for (i = 1; i < n; i++) {
+		if (tasks[i].started) {
+			pthread_join(tasks[i].tid, NULL);
+		} else {
+			_psplit_worker(&tasks[i]);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!tasks[i].out) { goto done; }
+	}
+
+	/* stitch the pieces together, in order */
+	list = tasks[0].out;
+	tasks[0].out = NULL;
+	for (i = 1; i < n; i++) {
+		if (_sl_splice(list, tasks[i].out) != 0) {
+			stringlist_free(list);
+			list = NULL;
+			goto done;
+		}
+	}
+
+done:
+	for (i = 0; i < n; i++) {
+		stringlist_free(tasks[i].out);
+	}
+	free(tasks);
+	return list;
+}
+
+/**
+  Split $str on any of the bytes in $set, and return the result.
+
+  This follows the same rules as @stringlist_split, except that
+  every byte in $set (see @byteset_init) is a delimiter; see
+  @split_iter_init_set.  It is meant for input separated by
+  whitespace, or by any one of a handful of punctuation characters:
+
+  <code>
+  struct byteset sep;
+  byteset_init(&sep, ",;|", 3);
+  struct stringlist *l = stringlist_split_set("a,b;c|d", 7, &sep, SPLIT_NORMAL);
+  // List l now contains four strings: 'a', 'b', 'c', and 'd'
+  </code>
+
+  With `SPLIT_GREEDY`, a run of delimiters counts as one.  As with
+  @stringlist_split, `SPLIT_ARENA` stores the tokens in an arena.
+
+  On success, returns a new stringlist.  On failure, returns NULL.
+ */
+struct stringlist* stringlist_split_set(const char *str, size_t len, const struct byteset *set, int opt)
+{
+	assert(str); // LCOV_EXCL_LINE
+	assert(set); // LCOV_EXCL_LINE
+
+	struct stringlist *list;
+	struct split_iter it;
+	struct strview tok;
 
-			if (stringlist_add(list, item) != 0) {
-				stringlist_free(list);
+	if (!(list = _sl_new(NULL, NULL, opt & SPLIT_ARENA ? SL_ARENA : 0))) { return NULL; }
+
+	split_iter_init_set(&it, str, len, set, opt & ~SPLIT_STREAM);
+	while (split_iter_next(&it, &tok)) {
+		if (stringlist_addv(list, tok) != 0) {
+			stringlist_free(list);
+			return NULL;
+		}
+	}
+
+	return list;
+}
+
+/* Read everything from $fd, and split it on $delim. */
+static struct stringlist* _sl_read_split(int fd, const char *delim, int opt)
+{
+	struct stringlist *list;
+	char *buf, *tmp;
+	size_t len = 0, size = 65536;
+	ssize_t n;
+
+	if (!(buf = malloc(size))) { return NULL; }
+	for (;;) {
+		if (len == size) {
+			if (!(tmp = realloc(buf, size * 2))) {
+				free(buf);
 				return NULL;
 			}
+			buf = tmp;
+			size *= 2;
+		}
+
+		n = read(fd, buf + len, size - len);
+		if (n == 0) { break; }
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			free(buf);
+			return NULL;
+		}
+		len += n;
+	}
+
+	list = stringlist_split(buf, len, delim, (opt & SPLIT_GREEDY) | SPLIT_ARENA);
+	free(buf);
+	return list;
+}
+
+/**
+  Read the file at $path, and split its contents on $delim.
+
+  This follows the same rules as @stringlist_split, but instead of
+  reading the file into memory and then copying each token out of
+  it, the file is mapped into memory with `mmap(2)`, and the strings
+  of the list point straight into the mapping.  The delimiter after
+  each token is overwritten with a NULL-terminator; the mapping is
+  private, so the file itself is never modified.  Once the list has
+  been built, the mapping is made read-only, and it is unmapped by
+  @stringlist_free.
+
+  **Note:** writing those NULL-terminators gives the process its own
+  copy of every page of the file that contains a delimiter, which for
+  a line-oriented file is every page.  Those copies are anonymous
+  memory, which the kernel cannot simply drop (as it could unmodified
+  pages of the file) when memory is tight, so a list built from a
+  4GB file holds on to about 4GB of memory, just as if the file had
+  been read in.  What is saved is the second copy that
+  @stringlist_split would make of each token, and the time spent
+  making it.
+
+  <code>
+  struct stringlist *hosts = stringlist_from_file("/etc/allow", "\n", SPLIT_GREEDY);
+  if (!hosts) {
+      // check errno
+  }
+  </code>
+
+  The list is otherwise arena-backed (see @stringlist_new_arena);
+  strings added to it later are copied into the arena as usual, and
+  the strings from the file must not be modified, or passed to
+  `free(3)`.
+
+  If $opt includes `SPLIT_COPY`, the file is mapped read-only, every
+  token is copied into the arena up front, and the file is unmapped
+  before this function returns.  The pages of the file are never
+  written to, so they stay in the page cache where the kernel can
+  reclaim them.  The strings can be modified, and the list does not
+  keep the file mapped.  The copying is not deferred until a string is
+  first used.  It can't be, because the list hands out plain
+  NULL-terminated pointers in `$list->strings`.
+
+  Files that cannot be mapped are read in and split with
+  @stringlist_split instead.  These include pipes, and files in `/proc`
+  and `/sys`, which report a size of zero but still have contents.
+
+  Files containing NULL bytes will have tokens cut short.
 
-			free(item);
+  On success, returns a new stringlist.  On failure, returns NULL
+  and `errno` is set appropriately.
+ */
+struct stringlist* stringlist_from_file(const char *path, const char *delim, int opt)
+{
+	assert(path);  // LCOV_EXCL_LINE
+	assert(delim); // LCOV_EXCL_LINE
+
+	struct stringlist *list;
+	struct split_iter it;
+	struct strview tok;
+	struct stat st;
+	char *map, *end, *s;
+	int fd, copy = opt & SPLIT_COPY;
+
+	if (!*delim) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((fd = open(path, O_RDONLY)) < 0) { return NULL; }
+	if (fstat(fd, &st) != 0 || !(list = stringlist_new_arena(NULL))) {
+		close(fd);
+		return NULL;
+	}
+	if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+		/* pipes, and files in /proc or /sys (which claim to be
+		   empty) can't be mapped; they have to be read */
+		stringlist_free(list);
+		list = _sl_read_split(fd, delim, opt);
+		close(fd);
+		return list;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ | (copy ? 0 : PROT_WRITE), MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		stringlist_free(list);
+		return NULL;
+	}
+	if (!(list->map = malloc(sizeof(struct sl_map)))) {
+		munmap(map, st.st_size);
+		stringlist_free(list);
+		return NULL;
+	}
+	list->map->addr = map;
+	list->map->len  = st.st_size;
+	end = map + st.st_size;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	split_iter_init(&it, map, st.st_size, delim, opt & SPLIT_GREEDY);
+	while (split_iter_next(&it, &tok)) {
+		if (copy) {
+			if (stringlist_addv(list, tok) != 0) { goto failed; }
+			continue;
+		}
+
+		s = (char*)tok.p;
+		if (s + tok.len < end) {
+			s[tok.len] = '\0';
+
+		} else if (st.st_size % sysconf(_SC_PAGESIZE) == 0) {
+			/* the final token runs right up to the end of the last
+			   page; there is nowhere to put its NULL-terminator */
+			if (!(s = _sl_arena_dup(list, tok))) { goto failed; }
 		}
-		a = b + delim_len;
+		/* (otherwise, the rest of the last page is zero-filled) */
+
+		if (_sl_capacity(list) == 0 && _sl_expand(list, 1) != 0) {
+			goto failed;
+		}
+		list->strings[list->num++] = s;
 	}
+	list->strings[list->num] = NULL;
 
+	if (copy) {
+		munmap(map, st.st_size);
+		free(list->map);
+		list->map = NULL;
+	} else {
+		mprotect(map, st.st_size, PROT_READ);
+	}
 	return list;
+
+failed:
+	stringlist_free(list);
+	return NULL;
+}
+
+/**
+  Split $str on $delim, without copying anything.
+
+  This follows the same rules as @stringlist_split, but instead of
+  building a list of copies, it fills in $out with views of (up to)
+  the first $max tokens, pointing straight into $str.  No memory is
+  allocated, so $str must outlive the views.
+
+  <code>
+  struct strview f[8];
+  ssize_t n = strview_split(f, 8, line, len, " ", SPLIT_NORMAL);
+  if (n >= 2 && strview_eq(f[0], strview_cstr("GET"))) {
+      handle_get(f[1]);
+  }
+  </code>
+
+  Returns the total number of tokens in $str, which may be more than
+  $max; as with `snprintf(3)`, a return value greater than $max means
+  that only the first $max tokens were stored.  Returns -1 on failure
+  (if $delim is the empty string).
+ */
+ssize_t strview_split(struct strview *out, size_t max, const char *str, size_t len, const char *delim, int opt)
+{
+	assert(out || max == 0); // LCOV_EXCL_LINE
+	assert(str);             // LCOV_EXCL_LINE
+	assert(delim);           // LCOV_EXCL_LINE
+
+	struct split_iter it;
+	struct strview tok;
+	size_t n;
+
+	if (!*delim) { return -1; }
+
+	split_iter_init(&it, str, len, delim, opt & ~SPLIT_STREAM);
+	for (n = 0; split_iter_next(&it, &tok); n++) {
+		if (n < max) { out[n] = tok; }
+	}
+	return n;
+}
+
+/**
+  Set up $it to split the $len bytes at $str on $delim, one token at a time.
+
+  Tokens are handed out by @split_iter_next, following the same rules as
+  @stringlist_split; $opt can be `SPLIT_NORMAL` or `SPLIT_GREEDY`, and
+  can also include `SPLIT_STREAM` for tokenizing input that arrives
+  a buffer at a time.  Nothing is copied, so $str and $delim must
+  outlive the iterator.
+
+  <code>
+  struct split_iter it;
+  struct strview tok;
+
+  split_iter_init(&it, line, len, "\t", SPLIT_NORMAL);
+  while (split_iter_next(&it, &tok)) {
+      // only look at as many fields as we need
+      if (handle_field(tok) == DONE) break;
+  }
+  </code>
+ */
+void split_iter_init(struct split_iter *it, const char *str, size_t len, const char *delim, int opt)
+{
+	assert(it);    // LCOV_EXCL_LINE
+	assert(str);   // LCOV_EXCL_LINE
+	assert(delim); // LCOV_EXCL_LINE
+
+	it->p         = str;
+	it->end       = str + len;
+	it->delim     = delim;
+	it->delim_len = strlen(delim);
+	it->opt       = opt;
+	it->set       = NULL;
+}
+
+/**
+  Set up $it to split the $len bytes at $str on any byte in $set.
+
+  This works like @split_iter_init, except that every byte in $set
+  (see @byteset_init) is a one-byte delimiter.  Delimiters are found
+  with @search_set, which checks many bytes at once.
+
+  With `SPLIT_GREEDY`, empty tokens are skipped, so a run of
+  delimiter bytes (i.e. a stretch of whitespace) separates two
+  tokens, no matter how long it is.
+
+  <code>
+  struct byteset ws;
+  struct split_iter it;
+  struct strview tok;
+
+  byteset_init(&ws, " \t\r\n", 4);
+  split_iter_init_set(&it, line, len, &ws, SPLIT_GREEDY);
+  while (split_iter_next(&it, &tok)) {
+      // ...
+  }
+  </code>
+
+  $set is not copied, so it must outlive the iterator.
+ */
+void split_iter_init_set(struct split_iter *it, const char *str, size_t len, const struct byteset *set, int opt)
+{
+	assert(it);  // LCOV_EXCL_LINE
+	assert(str); // LCOV_EXCL_LINE
+	assert(set); // LCOV_EXCL_LINE
+
+	it->p         = str;
+	it->end       = str + len;
+	it->delim     = NULL;
+	it->delim_len = 1;
+	it->opt       = opt;
+	it->set       = set;
+}
+
+/**
+  Find the next token for $it, and store a view of it in $tok.
+
+  In `SPLIT_STREAM` mode, a token is only handed out once the delimiter
+  that ends it has been seen; whatever is left over at the end of the
+  buffer (see @split_iter_tail) may continue in the next one.
+
+  Returns 1 if a token was found, or 0 if the input (or, when
+  streaming, the current buffer) is exhausted.
+ */
+int split_iter_next(struct split_iter *it, struct strview *tok)
+{
+	assert(it);  // LCOV_EXCL_LINE
+	assert(tok); // LCOV_EXCL_LINE
+
+	const char *b;
+
+	while (it->p < it->end) {
+		if (it->set) {
+			/* step over a run of delimiters, instead of handing out
+			   (and then skipping) an empty token for each one */
+			if (it->opt & SPLIT_GREEDY) {
+				for (; it->p < it->end && byteset_has(it->set, *it->p); it->p++)
+					;
+				if (it->p == it->end) { break; }
+			}
+			b = search_set(it->p, it->end - it->p, it->set);
+		} else {
+			b = it->delim_len ? search_str(it->p, it->end - it->p, it->delim, it->delim_len) : NULL;
+		}
+		if (!b) {
+			if (it->opt & SPLIT_STREAM) {
+				return 0; /* wait for the rest of the token */
+			}
+			b = it->end;
+		}
+
+		*tok = strview(it->p, b - it->p);
+		it->p = (b == it->end ? b : b + it->delim_len);
+		if (!(it->opt & SPLIT_GREEDY) || tok->len) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+  Get a view of the input that $it has not yet split.
+
+  When streaming, this is the start of a token (or of a delimiter)
+  that ran off the end of the buffer; it needs to be carried over to
+  the front of the next buffer handed to @split_iter_refill.
+ */
+struct strview split_iter_tail(const struct split_iter *it)
+{
+	assert(it); // LCOV_EXCL_LINE
+	return strview(it->p, it->end - it->p);
 }
 
+/**
+  Point $it at a new buffer of $len bytes at $str, to continue a streaming split.
+
+  The new buffer must start with the unsplit tail of the previous one
+  (see @split_iter_tail).  If $more is zero, this is the last buffer,
+  and `SPLIT_STREAM` mode is turned off so that the final token is
+  handed out even though no delimiter follows it.
+
+  The iterator puts no limit of its own on the size of a token.
+  However, each token, along with the delimiter that ends it, has to
+  fit in the caller's buffer.  If the unsplit tail fills the whole
+  buffer, there is no room left to read the rest of the token into.
+  The caller then has to grow the buffer, or give up, as the example
+  below does.  So with an 8k buffer, tokens can be at most 8k, less
+  the length of the delimiter.
+
+  <code>
+  char buf[8192];
+  ssize_t n;
+  struct strview tok, tail;
+  struct split_iter it;
+
+  split_iter_init(&it, buf, 0, "\n", SPLIT_GREEDY | SPLIT_STREAM);
+  do {
+      tail = split_iter_tail(&it);
+      if (tail.len == sizeof(buf)) {
+          // one line fills the whole buffer; it is too long
+          return -1;
+      }
+      memmove(buf, tail.p, tail.len);
+      n = read(fd, buf + tail.len, sizeof(buf) - tail.len);
+      if (n < 0) {
+          return -1;
+      }
+      split_iter_refill(&it, buf, tail.len + n, n > 0);
+
+      while (split_iter_next(&it, &tok)) {
+          handle_line(tok);
+      }
+  } while (n > 0);
+  </code>
+ */
+void split_iter_refill(struct split_iter *it, const char *str, size_t len, int more)
+{
+	assert(it);  // LCOV_EXCL_LINE
+	assert(str); // LCOV_EXCL_LINE
+
+	it->p   = str;
+	it->end = str + len;
+	if (!more) {
+		it->opt &= ~SPLIT_STREAM;
+	}
+}
@@ -0,0 +1,163 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+#include <errno.h>
+
+/* a sorted catalog of paths, with plenty of shared prefixes */
+static struct stringlist* catalog(size_t n)
+{
+	struct stringlist *sl = stringlist_new_arena(NULL);
+	char buf[128];
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "/srv/data/%s/%04lu/part-%05lu.log",
+			i % 3 == 0 ? "archive" : "current",
+			(unsigned long)(i / 100), (unsigned long)(i * 7 % 10007));
+		stringlist_add(sl, buf);
+	}
+	stringlist_sort(sl, STRINGLIST_SORT_ASC);
+	return sl;
+}
+
+NEW_TEST(fclist_basics)
+{
+	struct stringlist *sl;
+	struct fclist *fc;
+	struct fclist_cursor c;
+	struct string *buf = string_new(NULL, 0);
+	const char *s;
+	size_t n;
+
+	test("fclist: Build from a sorted list");
+	sl = stringlist_new(NULL);
+	stringlist_add(sl, "/etc/hosts");
+	stringlist_add(sl, "/etc/passwd");
+	stringlist_add(sl, "/etc/passwd");
+	stringlist_add(sl, "/etc/passwd-");
+	stringlist_add(sl, "/usr/bin/env");
+	fc = fclist_new(sl, 2);
+	assert_not_null("fclist_new succeeds", fc);
+	assert_int_eq("fclist has 5 strings", fclist_len(fc), 5);
+
+	test("fclist: Iterate in order");
+	n = 0;
+	for_each_fcstring(fc, &c, buf, s) {
+		assert_str_eq("strings come out in order", s, sl->strings[n]);
+		n++;
+	}
+	assert_int_eq("visited every string", n, 5);
+
+	test("fclist: Random access");
+	assert_int_eq("get string 3", fclist_get(fc, 3, buf), 0);
+	assert_str_eq("string 3", buf->raw, "/etc/passwd-");
+	assert_int_eq("get string 0", fclist_get(fc, 0, buf), 0);
+	assert_str_eq("string 0", buf->raw, "/etc/hosts");
+	assert_int_ne("get past the end", fclist_get(fc, 5, buf), 0);
+
+	test("fclist: Binary search");
+	assert_int_eq("find first string", fclist_search(fc, "/etc/hosts"), 0);
+	assert_int_eq("find first of duplicates", fclist_search(fc, "/etc/passwd"), 1);
+	assert_int_eq("find bucket head", fclist_search(fc, "/usr/bin/env"), 4);
+	assert_int_eq("find last in bucket", fclist_search(fc, "/etc/passwd-"), 3);
+	assert_int_eq("missing (too small)", fclist_search(fc, "/bin/sh"), -1);
+	assert_int_eq("missing (too large)", fclist_search(fc, "/var"), -1);
+	assert_int_eq("missing (prefix)", fclist_search(fc, "/etc/pass"), -1);
+	assert_int_eq("missing (between)", fclist_search(fc, "/etc/passwe"), -1);
+	assert_int_eq("missing (empty)", fclist_search(fc, ""), -1);
+	fclist_free(fc);
+
+	test("fclist: Refuse unsorted lists");
+	stringlist_add(sl, "/aaa");
+	errno = 0;
+	assert_null("fclist_new fails", fclist_new(sl, 2));
+	assert_int_eq("errno is EINVAL", errno, EINVAL);
+	stringlist_free(sl);
+
+	test("fclist: Empty list");
+	sl = stringlist_new(NULL);
+	fc = fclist_new(sl, 0);
+	assert_not_null("fclist_new succeeds", fc);
+	assert_int_eq("fclist is empty", fclist_len(fc), 0);
+	assert_int_eq("nothing found", fclist_search(fc, "x"), -1);
+	n = 0;
+	for_each_fcstring(fc, &c, buf, s) { n++; }
+	assert_int_eq("nothing visited", n, 0);
+	fclist_free(fc);
+	stringlist_free(sl);
+
+	string_free(buf);
+	fclist_free(NULL);
+}
+
+NEW_TEST(fclist_large)
+{
+	struct stringlist *sl;
+	struct fclist *fc;
+	struct fclist_cursor c;
+	struct string *buf = string_new(NULL, 0);
+	const char *s;
+	char missing[128];
+	size_t i, bytes, bucket;
+	int ok;
+
+	sl = catalog(20000);
+	for (bucket = 1; bucket <= 64; bucket *= 4) {
+		test("fclist: Round-trip a large catalog");
+		fc = fclist_new(sl, bucket);
+		assert_not_null("fclist_new succeeds", fc);
+
+		ok = 1; i = 0;
+		for_each_fcstring(fc, &c, buf, s) {
+			ok = ok && strcmp(s, sl->strings[i++]) == 0;
+		}
+		assert_true("iteration matches the list", ok && i == sl->num);
+
+		for (ok = 1, i = 0; i < sl->num; i += 37) {
+			ok = ok && fclist_get(fc, i, buf) == 0 && strcmp(buf->raw, sl->strings[i]) == 0;
+		}
+		assert_true("random access matches the list", ok);
+
+		for (ok = 1, i = 0; i < sl->num; i++) {
+			ok = ok && fclist_search(fc, sl->strings[i]) >= 0
+			        && strcmp(sl->strings[fclist_search(fc, sl->strings[i])], sl->strings[i]) == 0;
+			snprintf(missing, sizeof(missing), "%s~", sl->strings[i]);
+			ok = ok && fclist_search(fc, missing) == -1;
+		}
+		assert_true("every string is found, and nothing else", ok);
+
+		if (bucket == 16) {
+			for (bytes = i = 0; i < sl->num; i++) {
+				bytes += strlen(sl->strings[i]) + 1 + sizeof(char *);
+			}
+			assert_int_lt("front coding saves at least 3x", fclist_bytes(fc) * 3, bytes);
+		}
+		fclist_free(fc);
+	}
+
+	stringlist_free(sl);
+	string_free(buf);
+}
+
+NEW_SUITE(fclist)
+{
+	RUN_TEST(fclist_basics);
+	RUN_TEST(fclist_large);
+}
@@ -150,6 +150,87 @@ NEW_TEST(hash_for_each)
 	hash_free(h);
 }
 
+NEW_TEST(hash_views)
+{
+	struct hash *h;
+	const char *buf = "path=/etc;name=staff";
+
+	test("hash: Lookup and storage by view");
+	h = hash_new();
+	hash_set(h, "path", "/etc");
+
+	assert_str_eq("getv 'path' finds the hash_set value",
+		"/etc", hash_getv(h, strview(buf, 4)));
+	assert_null("getv 'pat' does not match 'path'", hash_getv(h, strview(buf, 3)));
+	assert_null("getv 'path=' does not match 'path'", hash_getv(h, strview(buf, 5)));
+	assert_null("getv 'path\\0...' does not match 'path'", hash_getv(h, strview("path\0/etc", 9)));
+
+	assert_str_eq("setv 'name' succeeds", "staff", hash_setv(h, strview(buf + 10, 4), "staff"));
+	assert_str_eq("get 'name' finds the hash_setv value", "staff", hash_get(h, "name"));
+	assert_str_eq("setv 'name' returns the old value",
+		"staff", hash_setv(h, strview_cstr("name"), "wheel"));
+	assert_str_eq("getv 'name' finds the new value", "wheel", hash_getv(h, strview_cstr("name")));
+
+	hash_free(h);
+}
+
+NEW_TEST(hash_interned)
+{
+	struct strtab *tab;
+	struct hash *h;
+	const char *key;
+	char *k, buf[16];
+	void *v;
+	struct hash_cursor c;
+	int n, ok;
+
+	test("hash: Interned keys");
+	tab = strtab_new();
+	h = hash_new_interned(tab);
+	assert_not_null("hash_new_interned returns a hash", h);
+
+	key = strtab_intern(tab, "host");
+	hash_set(h, key, "localhost");
+	hash_set(h, "port", "8080");
+
+	assert_str_eq("get by interned key", "localhost", hash_get(h, key));
+	assert_str_eq("get by plain string", "localhost", hash_get(h, "host"));
+	assert_str_eq("get by view", "8080", hash_getv(h, strview("port:", 4)));
+	assert_not_null("keys are interned in the table", strtab_lookup(tab, "port"));
+
+	for_each_key_value(h, &c, k, v) {
+		assert_ptr_eq("keys are the interned pointers", k, strtab_lookup(tab, k));
+	}
+
+	test("hash: Lookups by interned pointer");
+	assert_str_eq("get_interned finds 'host'", "localhost", hash_get_interned(h, key));
+	assert_str_eq("get_interned finds 'port'", "8080",
+		hash_get_interned(h, strtab_lookup(tab, "port")));
+	assert_null("get_interned misses an interned key that was never set",
+		hash_get_interned(h, strtab_intern(tab, "user")));
+	assert_null("get misses it too", hash_get(h, "user"));
+	assert_null("get misses a key that was never interned", hash_get(h, "nope"));
+	assert_null("getv misses a key that was never interned", hash_getv(h, strview_cstr("nope")));
+	assert_null("lookups don't intern", strtab_lookup(tab, "nope"));
+
+	test("hash: Interned keys share buckets");
+	for (n = 0; n < 500; n++) {
+		snprintf(buf, sizeof(buf), "key%d", n);
+		hash_setv(h, strview_cstr(buf), (void*)(long)(n + 1));
+	}
+	for (ok = 1, n = 0; n < 500; n++) {
+		snprintf(buf, sizeof(buf), "key%d", n);
+		ok = ok && hash_get(h, buf) == (void*)(long)(n + 1)
+		        && hash_get_interned(h, strtab_lookup(tab, buf)) == (void*)(long)(n + 1);
+	}
+	assert_true("every key is found, by string and by pointer", ok);
+	assert_ptr_eq("set returns the old value", (void*)(long)1, hash_set(h, "key0", "zero"));
+	assert_str_eq("and stores the new one", "zero", hash_getv(h, strview("key0=", 4)));
+
+	hash_free(h);
+	strtab_free(tab);
+}
+
 NEW_SUITE(hash)
 {
 	RUN_TEST(hash_functions);
@@ -157,6 +238,8 @@ NEW_SUITE(hash)
 	RUN_TEST(hash_collisions);
 	RUN_TEST(hash_overrides);
 	RUN_TEST(hash_get_null);
+	RUN_TEST(hash_views);
+	RUN_TEST(hash_interned);
 
 	RUN_TEST(hash_for_each);
 }
@@ -45,6 +45,20 @@ NEW_TEST(path_creation)
 	path_free(p);
 }
 
+NEW_TEST(path_creation_from_view)
+{
+	struct path *p;
+	const char *buf = "/etc/passwd:/etc/group";
+
+	test("path: Creation of new paths from views");
+	p = path_newv(strview(buf, 11));
+	assert_not_null("path_newv returns a path", p);
+	assert_str_eq("path_newv copies just the view", path(p), "/etc/passwd");
+	assert_int_eq("path_canon returns 0", path_canon(p), 0);
+	assert_str_eq("path is canonical", path(p), "/etc/passwd");
+	path_free(p);
+}
+
 NEW_TEST(path_canon)
 {
 	test("path: Canonicalization (normal case)");
@@ -151,6 +165,7 @@ NEW_TEST(path_free_null)
 NEW_SUITE(path)
 {
 	RUN_TEST(path_creation);
+	RUN_TEST(path_creation_from_view);
 	RUN_TEST(path_canon);
 	RUN_TEST(path_push_pop);
 	RUN_TEST(path_free_null);
@@ -0,0 +1,152 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+/* leftmost-longest replacement, the slow way */
+static struct string* naive_replace(const struct hash *h, const char *src, size_t len)
+{
+	struct string *s = string_new(NULL, 0);
+	struct hash_cursor cur;
+	size_t i, klen, best;
+	char *k, *v, *with;
+
+	for (i = 0; i < len; ) {
+		best = 0; with = NULL;
+		for_each_key_value(h, &cur, k, v) {
+			klen = strlen(k);
+			if (klen > best && klen <= len - i && memcmp(src + i, k, klen) == 0) {
+				best = klen;
+				with = v;
+			}
+		}
+		if (best) {
+			string_append(s, with);
+			i += best;
+		} else {
+			string_append1(s, src[i++]);
+		}
+	}
+	return s;
+}
+
+NEW_TEST(replacer_basics)
+{
+	struct hash *h = hash_new();
+	struct replacer *r;
+	struct string *s;
+	const char *src;
+
+	test("replacer: several patterns at once");
+	hash_set(h, "cat", "dog");
+	hash_set(h, "catalog", "list");
+	hash_set(h, "log", "journal");
+	hash_set(h, "a", NULL);
+	r = replacer_new(h);
+	assert_not_null("replacer_new succeeds", r);
+
+	src = "a cat catalog log";
+	s = replacer_apply(r, src, strlen(src));
+	assert_not_null("replacer_apply succeeds", s);
+	assert_str_eq("patterns replaced", s->raw, " dog list journal");
+	string_free(s);
+
+	src = "catalo";
+	s = replacer_apply(r, src, strlen(src));
+	assert_str_eq("partial match of a longer pattern", s->raw, "doglo");
+	string_free(s);
+
+	src = "xyz";
+	s = replacer_apply(r, src, strlen(src));
+	assert_str_eq("no match copies the source", s->raw, "xyz");
+	string_free(s);
+
+	s = replacer_apply(r, "", 0);
+	assert_str_eq("empty input", s->raw, "");
+	string_free(s);
+
+	test("replacer: leftmost match wins over a longer, later one");
+	hash_set(h, "bc", "2");
+	hash_set(h, "xbcde", "5");
+	replacer_free(r);
+	r = replacer_new(h);
+	src = "xbcdf abcde xbcde";
+	s = replacer_apply(r, src, strlen(src));
+	assert_str_eq("overlaps resolved left-to-right", s->raw, "x2df 2de 5");
+	string_free(s);
+
+	replacer_free(r);
+	hash_free(h);
+}
+
+NEW_TEST(replacer_rejects)
+{
+	struct hash *h = hash_new();
+
+	test("replacer: bad patterns");
+	assert_null("no patterns", replacer_new(h));
+	hash_set(h, "ok", "fine");
+	hash_set(h, "", "empty");
+	assert_null("empty pattern", replacer_new(h));
+
+	hash_free(h);
+}
+
+NEW_TEST(replacer_random)
+{
+	struct hash *h;
+	struct replacer *r;
+	struct string *got, *want;
+	char src[200], key[6];
+	size_t i, j, n, len;
+	int ok;
+
+	test("replacer: agrees with a naive leftmost-longest search");
+	srand(32);
+	for (ok = 1, i = 0; i < 300 && ok; i++) {
+		h = hash_new();
+		for (n = 1 + rand() % 6, j = 0; j < n; j++) {
+			for (len = 1 + rand() % 5, key[len] = '\0'; len--; ) {
+				key[len] = 'a' + rand() % 3;
+			}
+			hash_set(h, key, j % 2 ? "<>" : "");
+		}
+		for (len = rand() % sizeof(src), j = 0; j < len; j++) {
+			src[j] = 'a' + rand() % 3;
+		}
+
+		r = replacer_new(h);
+		got  = replacer_apply(r, src, len);
+		want = naive_replace(h, src, len);
+		ok = got && got->len == want->len && strcmp(got->raw, want->raw) == 0;
+
+		string_free(got);
+		string_free(want);
+		replacer_free(r);
+		hash_free(h);
+	}
+	assert_true("all random replacements agree", ok);
+}
+
+NEW_SUITE(replace)
+{
+	RUN_TEST(replacer_basics);
+	RUN_TEST(replacer_rejects);
+	RUN_TEST(replacer_random);
+}
@@ -0,0 +1,194 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+static void assert_rope(const char *msg, struct rope *r, const char *expect)
+{
+	struct string *s = rope_string(r);
+
+	assert_not_null("rope_string returns a string", s);
+	assert_int_eq("rope is as long as expected", rope_len(r), strlen(expect));
+	assert_str_eq(msg, expect, s->raw);
+	string_free(s);
+}
+
+NEW_TEST(rope_basics)
+{
+	struct rope *r;
+
+	test("rope: Creation");
+	r = rope_new(NULL);
+	assert_not_null("rope_new returns a rope", r);
+	assert_rope("new rope is empty", r, "");
+	rope_free(r);
+
+	r = rope_new("<html></html>");
+	assert_rope("new rope has initial value", r, "<html></html>");
+
+	test("rope: Insertion");
+	assert_int_eq("insert <body> tags", rope_insert(r, 6, "<body></body>", 13), 0);
+	assert_int_eq("insert Hello", rope_insert(r, 12, "Hello", 5), 0);
+	assert_rope("inserted in the middle", r, "<html><body>Hello</body></html>");
+	assert_int_ne("insert past the end fails", rope_insert(r, 1000, "!", 1), 0);
+	assert_rope("failed insert leaves rope alone", r, "<html><body>Hello</body></html>");
+
+	test("rope: Appending");
+	assert_int_eq("append a newline", rope_append(r, "\n", 1), 0);
+	assert_rope("appended at the end", r, "<html><body>Hello</body></html>\n");
+
+	test("rope: Deletion");
+	assert_int_eq("delete Hello", rope_delete(r, 12, 5), 0);
+	assert_rope("deleted from the middle", r, "<html><body></body></html>\n");
+	assert_int_eq("delete past the end", rope_delete(r, 19, 100), 0);
+	assert_rope("deleted to the end", r, "<html><body></body>");
+
+	rope_free(r);
+}
+
+NEW_TEST(rope_concat_substr)
+{
+	struct rope *a, *b, *sub;
+
+	test("rope: Concatenation");
+	a = rope_new("Hello, ");
+	b = rope_new("World!");
+	assert_int_eq("concat a + b", rope_concat(a, b), 0);
+	assert_rope("a is now the concatenation", a, "Hello, World!");
+	assert_rope("b is untouched", b, "World!");
+
+	assert_int_eq("concat a + a", rope_concat(a, a), 0);
+	assert_rope("self-concatenation", a, "Hello, World!Hello, World!");
+
+	test("rope: Substrings");
+	sub = rope_substr(a, 7, 6);
+	assert_rope("substr(7, 6)", sub, "World!");
+	rope_free(sub);
+
+	sub = rope_substr(a, 20, 100);
+	assert_rope("substr past the end is clamped", sub, "World!");
+	rope_free(sub);
+
+	assert_null("substr starting past the end fails", rope_substr(a, 100, 1));
+
+	rope_free(a);
+	rope_free(b);
+}
+
+NEW_TEST(rope_chunks)
+{
+	struct rope *r;
+	struct rope_cursor c;
+	struct iovec iov[4];
+	char buf[8192];
+	const char *p;
+	size_t len, total, n, i;
+
+	memset(buf, 'x', sizeof(buf));
+	r = rope_new(NULL);
+	rope_append(r, buf, sizeof(buf));
+	rope_insert(r, 4096, "abc", 3);
+
+	test("rope: Chunk iteration");
+	total = n = 0;
+	for_each_chunk(r, &c, p, len) {
+		assert_int_gt("chunks are never empty", len, 0);
+		total += len;
+		n++;
+	}
+	assert_int_eq("chunks add up to the whole rope", total, sizeof(buf) + 3);
+	assert_int_gt("large ropes are stored in several chunks", n, 1);
+
+	test("rope: iovec batches");
+	c.n = -1;
+	total = 0;
+	while ((n = rope_iov(r, &c, iov, 4)) > 0) {
+		assert_int_le("never more than 4 iovecs at once", n, 4);
+		for (i = 0; i < n; i++) {
+			total += iov[i].iov_len;
+		}
+	}
+	assert_int_eq("iovecs add up to the whole rope", total, sizeof(buf) + 3);
+
+	rope_free(r);
+}
+
+NEW_TEST(rope_random_edits)
+{
+	struct rope *r, *sub;
+	struct string *s;
+	char ref[65536], frag[600];
+	size_t len = 0, pos, n, i;
+	int ok = 1;
+
+	test("rope: Random edits agree with a flat buffer");
+	srand(42);
+	r = rope_new(NULL);
+	for (i = 0; i < 2000 && ok; i++) {
+		n = rand() % sizeof(frag);
+		memset(frag, 'a' + i % 26, n);
+
+		if (rand() % 4 == 0 && len > 0) {
+			pos = rand() % len;
+			n = n % (len - pos + 1);
+			ok = rope_delete(r, pos, n) == 0;
+			memmove(ref + pos, ref + pos + n, len - pos - n);
+			len -= n;
+
+		} else if (len + n < sizeof(ref)) {
+			pos = len ? rand() % (len + 1) : 0;
+			ok = rope_insert(r, pos, frag, n) == 0;
+			memmove(ref + pos + n, ref + pos, len - pos);
+			memcpy(ref + pos, frag, n);
+			len += n;
+		}
+		ok = ok && rope_len(r) == len;
+	}
+	ref[len] = '\0';
+	assert_true("all edits succeeded", ok);
+	assert_rope("rope matches the flat buffer", r, ref);
+
+	pos = len / 3;
+	sub = rope_substr(r, pos, len / 2);
+	s = rope_string(sub);
+	assert_int_eq("substring has the right length", s->len, len / 2);
+	assert_int_eq("substring has the right contents", memcmp(s->raw, ref + pos, len / 2), 0);
+	string_free(s);
+	rope_free(sub);
+
+	rope_free(r);
+}
+
+NEW_TEST(rope_free_null)
+{
+	struct rope *r;
+
+	test("rope: rope_free(NULL)");
+	r = NULL; rope_free(r);
+	assert_null("rope_free(NULL) doesn't segfault", r);
+}
+
+NEW_SUITE(rope)
+{
+	RUN_TEST(rope_basics);
+	RUN_TEST(rope_concat_substr);
+	RUN_TEST(rope_chunks);
+	RUN_TEST(rope_random_edits);
+	RUN_TEST(rope_free_null);
+}
@@ -26,6 +26,10 @@ int main(int argc, char **argv)
 	TEST_SUITE(pack);
 	TEST_SUITE(path);
 	TEST_SUITE(hash);
+	TEST_SUITE(rope);
+	TEST_SUITE(search);
+	TEST_SUITE(replace);
+	TEST_SUITE(fclist);
 
 	return run_tests(argc, argv);
 }
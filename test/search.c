@@ -0,0 +1,135 @@
+/*
+  Copyright 2011 James Hunt <james@jameshunt.us>
+
+  This file is part of libgear, a C framework library.
+
+  libgear is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libgear is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libgear.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+static const char* naive_set(const char *s, size_t n, const char *set, size_t m)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		if (memchr(set, s[i], m)) {
+			return s + i;
+		}
+	}
+	return NULL;
+}
+
+static const char* naive_str(const char *hay, size_t n, const char *needle, size_t m)
+{
+	size_t i;
+	for (i = 0; i + m <= n; i++) {
+		if (memcmp(hay + i, needle, m) == 0) {
+			return hay + i;
+		}
+	}
+	return NULL;
+}
+
+NEW_TEST(search_byte)
+{
+	const char *s = "the quick brown fox";
+
+	test("search: single bytes");
+	assert_ptr_eq("find 'q'", search_byte(s, strlen(s), 'q'), s + 4);
+	assert_ptr_eq("find the first 'o'", search_byte(s, strlen(s), 'o'), s + 12);
+	assert_null("no 'z'", search_byte(s, strlen(s), 'z'));
+	assert_null("'x' is outside the first 10 bytes", search_byte(s, 10, 'x'));
+	assert_null("nothing in an empty buffer", search_byte(s, 0, 't'));
+}
+
+NEW_TEST(search_set)
+{
+	struct byteset ws, wide, hibit;
+	const char *s = "key=value; other\tfield\n";
+	char buf[300];
+	size_t i, n, pos;
+	int ok;
+
+	test("search: byte sets");
+	byteset_init(&ws, " \t\r\n", 4);
+	assert_int_eq("whitespace set has 4 members", ws.n, 4);
+	assert_ptr_eq("find the first whitespace", search_set(s, strlen(s), &ws), s + 10);
+	assert_ptr_eq("find the tab", search_set(s + 11, strlen(s) - 11, &ws), s + 16);
+	assert_null("no whitespace in the first 10 bytes", search_set(s, 10, &ws));
+
+	byteset_init(&wide, "=;,|:/\\-_.!@#$%^&*()", 20);
+	assert_ptr_eq("find '=' with a large set", search_set(s, strlen(s), &wide), s + 3);
+
+	byteset_init(&hibit, "\x80\xff\0", 3);
+	memset(buf, 'a', sizeof(buf));
+	buf[290] = '\xff';
+	assert_ptr_eq("find high-bit bytes", search_set(buf, sizeof(buf), &hibit), buf + 290);
+	buf[100] = '\0';
+	assert_ptr_eq("find NULL bytes", search_set(buf, sizeof(buf), &hibit), buf + 100);
+
+	test("search: byte sets agree with a naive search");
+	srand(31);
+	for (ok = 1, i = 0; i < 2000 && ok; i++) {
+		n = rand() % sizeof(buf);
+		for (pos = 0; pos < n; pos++) {
+			buf[pos] = 'a' + rand() % 26;
+		}
+		if (n && rand() % 2) {
+			buf[rand() % n] = " |;"[rand() % 3];
+		}
+		ok = search_set(buf, n, &wide) == naive_set(buf, n, "=;,|:/\\-_.!@#$%^&*()", 20)
+		  && search_set(buf, n, &ws)   == naive_set(buf, n, " \t\r\n", 4);
+	}
+	assert_true("all random searches agree", ok);
+}
+
+NEW_TEST(search_str)
+{
+	const char *s = "apple--mango--pear";
+	char buf[300];
+	char needle[8];
+	size_t i, n, m, pos;
+	int ok;
+
+	test("search: substrings");
+	assert_ptr_eq("find '--'", search_str(s, strlen(s), "--", 2), s + 5);
+	assert_ptr_eq("find 'pear'", search_str(s, strlen(s), "pear", 4), s + 14);
+	assert_ptr_eq("find 'o--p'", search_str(s, strlen(s), "o--p", 4), s + 11);
+	assert_null("no 'kiwi'", search_str(s, strlen(s), "kiwi", 4));
+	assert_null("'pear' is cut off", search_str(s, strlen(s) - 1, "pear", 4));
+	assert_null("needle longer than haystack", search_str(s, 3, "apple", 5));
+	assert_ptr_eq("empty needle matches at the start", search_str(s, strlen(s), "", 0), s);
+
+	test("search: substrings agree with a naive search");
+	srand(17);
+	for (ok = 1, i = 0; i < 5000 && ok; i++) {
+		n = rand() % sizeof(buf);
+		m = 1 + rand() % sizeof(needle);
+		for (pos = 0; pos < n; pos++) {
+			buf[pos] = 'a' + rand() % 3;
+		}
+		for (pos = 0; pos < m; pos++) {
+			needle[pos] = 'a' + rand() % 3;
+		}
+		ok = search_str(buf, n, needle, m) == naive_str(buf, n, needle, m);
+	}
+	assert_true("all random searches agree", ok);
+}
+
+NEW_SUITE(search)
+{
+	RUN_TEST(search_byte);
+	RUN_TEST(search_set);
+	RUN_TEST(search_str);
+}
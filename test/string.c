@@ -20,6 +20,8 @@
 #include "test.h"
 
 #include <stdarg.h>
+#include <ctype.h>
+#include <pthread.h>
 
 static void assert_auto_string(struct string *s, const char *value)
 {
@@ -156,6 +158,155 @@ NEW_TEST(string_interpolate_short_stroke)
 	hash_free(context);
 }
 
+static void assert_fd_contents(const char *msg, int fd, const char *expect)
+{
+	char buf[8192];
+	ssize_t n;
+
+	lseek(fd, 0, SEEK_SET);
+	n = read(fd, buf, sizeof(buf) - 1);
+	buf[n < 0 ? 0 : n] = '\0';
+	assert_str_eq(msg, expect, buf);
+}
+
+NEW_TEST(string_interpolate_fd)
+{
+	struct hash *context;
+	struct string *tpl, *expect;
+	FILE *io;
+	size_t i;
+
+	test("STRING: Interpolation to a file descriptor");
+	context = hash_new();
+	hash_set(context, "ref1", "this is a reference");
+	hash_set(context, "multi.level.fact", "MULTILEVEL");
+
+	io = tmpfile();
+	assert_not_null("(test sanity) tmpfile must return a valid FILE", io);
+	if (!io) { return; }
+
+	assert_int_eq("string_interpolate_fd returns 0",
+		string_interpolate_fd(fileno(io), "ref: $ref1, ${multi.level.fact} \\$ref1 $unknown.", context), 0);
+	assert_fd_contents("interpolated output written to fd", fileno(io),
+		"ref: this is a reference, MULTILEVEL $ref1 .");
+	fclose(io);
+
+	test("STRING: Interpolation to a file descriptor (many iovecs)");
+	tpl    = string_new(NULL, 0);
+	expect = string_new(NULL, 0);
+	for (i = 0; i < 100; i++) {
+		string_append(tpl, "[$ref1]");
+		string_append(expect, "[this is a reference]");
+	}
+
+	io = tmpfile();
+	assert_int_eq("string_interpolate_fd returns 0",
+		string_interpolate_fd(fileno(io), tpl->raw, context), 0);
+	assert_fd_contents("all 100 references written to fd", fileno(io), expect->raw);
+	fclose(io);
+
+	test("STRING: Interpolation to a FILE*");
+	io = tmpfile();
+	assert_int_eq("string_interpolate_FILE returns 0",
+		string_interpolate_FILE(io, "${multi.level.fact}: $ref1!", context), 0);
+	fflush(io);
+	assert_fd_contents("interpolated output written to FILE", fileno(io),
+		"MULTILEVEL: this is a reference!");
+	fclose(io);
+
+	string_free(tpl);
+	string_free(expect);
+	hash_free(context);
+}
+
+/* resolves every reference to its own name, in upper case, and counts calls */
+static char* resolve_upper(struct strview ref, void *udata)
+{
+	char *v;
+	size_t i;
+
+	if (strview_eq(ref, strview_cstr("nope"))) { return NULL; }
+
+	(*(int*)udata)++;
+	v = strview_dup(ref);
+	for (i = 0; v[i]; i++) {
+		v[i] = toupper(v[i]);
+	}
+	return v;
+}
+
+NEW_TEST(string_render)
+{
+	struct hash *context;
+	struct resolver upper, vars, env;
+	char buf[256], name[300], *v;
+	int calls = 0;
+	FILE *io;
+
+	context = hash_new();
+	hash_set(context, "host", "example.com");
+	hash_set(context, "nope", "not here");
+
+	upper.resolve = resolve_upper;
+	upper.udata   = &calls;
+	upper.next    = NULL;
+
+	test("STRING: Render with a resolver");
+	assert_int_eq("string_render returns 0",
+		string_render(buf, sizeof(buf), "$host/$path/$host/${host}/$nope.", &upper), 0);
+	assert_str_eq("references resolved", buf, "HOST/PATH/HOST/HOST/.");
+	assert_int_eq("each distinct reference is resolved once", calls, 2);
+
+	calls = 0;
+	assert_int_eq("string_render returns 0",
+		string_render(buf, sizeof(buf), "no references", &upper), 0);
+	assert_str_eq("literal text copied", buf, "no references");
+	assert_int_eq("nothing resolved if nothing is referenced", calls, 0);
+
+	test("STRING: Render with a resolver chain");
+	vars.resolve = RESOLVE_HASH;
+	vars.udata   = context;
+	vars.next    = &upper;
+	calls = 0;
+	assert_int_eq("string_render returns 0",
+		string_render(buf, sizeof(buf), "$host:$port $nope", &vars), 0);
+	assert_str_eq("first resolver wins", buf, "example.com:PORT not here");
+	assert_int_eq("later resolvers only consulted for misses", calls, 1);
+
+	test("STRING: Render from the environment");
+	setenv("GEAR_TEST_VAR", "from-env", 1);
+	env.resolve = RESOLVE_ENV;
+	env.udata   = NULL;
+	env.next    = NULL;
+	assert_int_eq("string_render returns 0",
+		string_render(buf, sizeof(buf), "[${GEAR_TEST_VAR}|${GEAR_TEST_UNSET}]", &env), 0);
+	assert_str_eq("environment variables resolved", buf, "[from-env|]");
+
+	memset(name, 'V', sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	setenv(name, "long", 1);
+	v = RESOLVE_ENV(strview_cstr(name), NULL);
+	assert_str_eq("long names are resolved", v, "long");
+	free(v);
+	unsetenv(name);
+	assert_null("long names can be unset", RESOLVE_ENV(strview_cstr(name), NULL));
+
+	test("STRING: Render to a file descriptor");
+	io = tmpfile();
+	assert_not_null("(test sanity) tmpfile must return a valid FILE", io);
+	if (!io) { return; }
+	assert_int_eq("string_render_fd returns 0",
+		string_render_fd(fileno(io), "$host ${GEAR_TEST_VAR}", &vars), 0);
+	vars.next = &env;
+	assert_int_eq("string_render_fd returns 0",
+		string_render_fd(fileno(io), " $host ${GEAR_TEST_VAR}", &vars), 0);
+	assert_fd_contents("rendered output written to fd", fileno(io),
+		"example.com GEAR_TEST_VAR example.com from-env");
+	fclose(io);
+
+	hash_free(context);
+}
+
 NEW_TEST(string_automatic)
 {
 	struct string *s = string_new(NULL, 0);
@@ -216,6 +367,134 @@ NEW_TEST(string_free_null)
 	assert_null("string_free(NULL) doesn't segfault", s);
 }
 
+NEW_TEST(strview)
+{
+	const char *buf = "GET /index.html HTTP/1.1";
+	struct strview method, uri, v;
+	struct string *s;
+	char *dup;
+
+	test("STRVIEW: construction");
+	method = strview(buf, 3);
+	uri    = strview(buf + 4, 11);
+	assert_ptr_eq("strview() keeps the pointer", method.p, buf);
+	assert_int_eq("strview() keeps the length", method.len, 3);
+	v = strview_cstr("index");
+	assert_int_eq("strview_cstr() uses strlen()", v.len, 5);
+	v = strview_cstr(NULL);
+	assert_int_eq("strview_cstr(NULL) is empty", v.len, 0);
+
+	test("STRVIEW: comparison");
+	assert_true("GET == GET", strview_eq(method, strview_cstr("GET")));
+	assert_false("GET != GE", strview_eq(method, strview_cstr("GE")));
+	assert_int_eq("cmp(GET, GET) == 0", strview_cmp(method, strview_cstr("GET")), 0);
+	assert_int_lt("cmp(GE, GET) < 0", strview_cmp(strview_cstr("GE"), method), 0);
+	assert_int_gt("cmp(GET, GEM) > 0", strview_cmp(method, strview_cstr("GEM")), 0);
+
+	test("STRVIEW: hashing");
+	assert_int_eq("strview_hash() agrees with H64()",
+		strview_hash(strview_cstr("multi.level.fact")) & 0x3f, H64("multi.level.fact"));
+	assert_int_eq("strview_hash() only looks at the view",
+		strview_hash(method), strview_hash(strview_cstr("GET")));
+
+	test("STRVIEW: searching");
+	assert_ptr_eq("find '/' in the uri", strview_chr(uri, '/'), buf + 4);
+	assert_null("no ' ' in the uri", strview_chr(uri, ' '));
+	assert_ptr_eq("find 'html' in the buffer",
+		strview_find(strview_cstr(buf), strview_cstr("html")), buf + 11);
+	assert_null("'HTTP' is not in the uri", strview_find(uri, strview_cstr("HTTP")));
+	assert_null("'index.html!' runs past the view",
+		strview_find(uri, strview_cstr("index.html!")));
+	assert_ptr_eq("empty needle matches at the start",
+		strview_find(uri, strview_cstr("")), uri.p);
+
+	test("STRVIEW: conversion");
+	dup = strview_dup(uri);
+	assert_str_eq("strview_dup() NULL-terminates", dup, "/index.html");
+	free(dup);
+
+	s = string_new("uri=", 0);
+	assert_int_eq("string_appendv returns 0", string_appendv(s, uri), 0);
+	assert_auto_string(s, "uri=/index.html");
+	string_free(s);
+}
+
+NEW_TEST(strtab)
+{
+	struct strtab *tab;
+	const char *a, *b, *c;
+	char buf[32];
+	unsigned int i;
+
+	test("STRTAB: Interning strings");
+	tab = strtab_new();
+	assert_not_null("strtab_new returns a table", tab);
+
+	strcpy(buf, "content-type");
+	a = strtab_intern(tab, "content-type");
+	b = strtab_intern(tab, buf);
+	c = strtab_internv(tab, strview("content-length", 7));
+	assert_str_eq("interned string has the right value", a, "content-type");
+	assert_ptr_eq("equal strings intern to the same pointer", a, b);
+	assert_ptr_eq("interned views do too", c, strtab_intern(tab, "content"));
+	assert_ptr_ne("interned copy is not the original", b, buf);
+	assert_ptr_ne("different strings intern differently", a, c);
+	assert_str_eq("interned view is NULL-terminated", c, "content");
+
+	test("STRTAB: Cached length and hash");
+	assert_int_eq("intern_len", intern_len(a), 12);
+	assert_int_eq("intern_hash", intern_hash(a), strview_hash(strview_cstr("content-type")));
+
+	test("STRTAB: Lookup");
+	assert_ptr_eq("lookup finds interned string", strtab_lookup(tab, buf), a);
+	assert_null("lookup does not intern", strtab_lookup(tab, "accept"));
+	assert_null("lookup still does not find it", strtab_lookup(tab, "accept"));
+
+	test("STRTAB: Growth");
+	for (i = 0; i < 1000; i++) {
+		snprintf(buf, sizeof(buf), "key%u", i);
+		strtab_intern(tab, buf);
+	}
+	assert_str_eq("strings survive growing the table", strtab_lookup(tab, "key999"), "key999");
+	assert_ptr_eq("earlier strings keep their pointers", strtab_intern(tab, "content-type"), a);
+
+	strtab_free(tab);
+}
+
+NEW_TEST(stringlist_interned)
+{
+	struct strtab *tab;
+	struct stringlist *sl, *dup;
+	const char *apple;
+	char *seed[] = { "apple", "pear", NULL };
+
+	test("stringlist: Interned strings");
+	tab = strtab_new();
+	apple = strtab_intern(tab, "apple");
+
+	sl = stringlist_new_interned(seed, tab);
+	assert_stringlist(sl, "sl", 2, "apple", "pear");
+	assert_ptr_eq("seeded strings are interned", sl->strings[0], apple);
+
+	assert_int_eq("add an interned string", stringlist_add(sl, apple), 0);
+	assert_int_eq("add a view", stringlist_addv(sl, strview("pearl", 4)), 0);
+	assert_stringlist(sl, "sl", 4, "apple", "pear", "apple", "pear");
+	assert_ptr_eq("no copies of apple", sl->strings[2], apple);
+	assert_ptr_eq("no copies of pear", sl->strings[3], sl->strings[1]);
+
+	dup = stringlist_dup(sl);
+	assert_ptr_eq("duplicates share interned strings", dup->strings[1], sl->strings[1]);
+
+	assert_int_eq("remove apple", stringlist_remove(sl, "apple"), 0);
+	stringlist_uniq(sl);
+	assert_stringlist(sl, "sl", 2, "apple", "pear");
+	assert_str_eq("interned strings outlive removal", apple, "apple");
+
+	stringlist_free(sl);
+	stringlist_free(dup);
+	strtab_free(tab);
+}
+
 NEW_TEST(stringlist_init)
 {
 	struct stringlist *sl;
@@ -324,6 +603,68 @@ NEW_TEST(stringlist_basic_add_remove_search)
 	stringlist_free(sl);
 }
 
+NEW_TEST(stringlist_addv)
+{
+	const char *buf = "alpha,beta";
+	struct stringlist *sl = stringlist_new(NULL);
+
+	test("stringlist: Add views");
+	assert_int_eq("add a view of 'alpha'", stringlist_addv(sl, strview(buf, 5)), 0);
+	assert_int_eq("add a view of 'beta'", stringlist_addv(sl, strview(buf + 6, 4)), 0);
+	assert_stringlist(sl, "sl", 2, "alpha", "beta");
+
+	stringlist_free(sl);
+}
+
+NEW_TEST(stringlist_arena)
+{
+	char *seed[] = { "lorem", "ipsum", NULL };
+	struct stringlist *sl, *dup, *big;
+	char buf[32];
+	size_t i;
+	int ok;
+
+	test("stringlist: Arena-backed lists");
+	sl = stringlist_new_arena(seed);
+	assert_not_null("stringlist_new_arena succeeds", sl);
+	assert_stringlist(sl, "seeded arena list", 2, "lorem", "ipsum");
+	assert_ptr_ne("strings are copies", sl->strings[0], seed[0]);
+
+	assert_int_eq("add to an arena list", stringlist_add(sl, "dolor"), 0);
+	assert_int_eq("remove from an arena list", stringlist_remove(sl, "ipsum"), 0);
+	assert_stringlist(sl, "after add/remove", 2, "lorem", "dolor");
+
+	test("stringlist: Arena-backed lists across many blocks");
+	big = stringlist_new_arena(NULL);
+	for (i = 0; i < 100000; i++) {
+		snprintf(buf, sizeof(buf), "string #%lu", (unsigned long)i);
+		if (stringlist_add(big, buf) != 0) { break; }
+	}
+	assert_int_eq("all strings added", big->num, 100000);
+	for (ok = 1, i = 0; i < big->num && ok; i++) {
+		snprintf(buf, sizeof(buf), "string #%lu", (unsigned long)i);
+		ok = strcmp(big->strings[i], buf) == 0;
+	}
+	assert_true("all strings intact", ok);
+
+	test("stringlist: Duplicates and add_all use the arena");
+	dup = stringlist_dup(big);
+	assert_int_eq("dup has all strings", dup->num, 100000);
+	assert_str_eq("dup has the last string", dup->strings[99999], "string #99999");
+
+	assert_int_eq("add_all into an arena list", stringlist_add_all(sl, big), 0);
+	assert_int_eq("sl has all strings", sl->num, 100002);
+	assert_str_eq("sl has the first string", sl->strings[0], "lorem");
+	assert_str_eq("sl has the last string", sl->strings[100001], "string #99999");
+
+	stringlist_free(big);
+	assert_str_eq("copies outlive the original", sl->strings[100001], "string #99999");
+	assert_str_eq("dup outlives the original", dup->strings[12345], "string #12345");
+
+	stringlist_free(dup);
+	stringlist_free(sl);
+}
+
 NEW_TEST(stringlist_add_all)
 {
 	struct stringlist *sl1, *sl2;
@@ -373,6 +714,183 @@ NEW_TEST(stringlist_add_all_with_expansion)
 	stringlist_free(sl2);
 }
 
+NEW_TEST(stringlist_reserve_add_n)
+{
+	struct stringlist *sl;
+	char *fruit[] = { "pear", "apple", "fig", NULL };
+	char **before;
+	size_t len;
+
+	test("stringlist: Reserve room for strings");
+	sl = stringlist_new(NULL);
+	assert_int_eq("reserve 1000 strings", stringlist_reserve(sl, 1000), 0);
+	assert_int_gt("room for 1000 strings (and a NULL)", sl->len, 1000);
+	len = sl->len; before = sl->strings;
+	assert_int_eq("reserving less is a no-op", stringlist_reserve(sl, 10), 0);
+	assert_int_eq("length unchanged", sl->len, len);
+
+	test("stringlist: Add many strings at once");
+	assert_int_eq("add_n succeeds", stringlist_add_n(sl, fruit, 3), 0);
+	assert_stringlist(sl, "after add_n", 3, "pear", "apple", "fig");
+	assert_ptr_eq("no reallocation needed", sl->strings, before);
+	assert_int_eq("add_n of nothing", stringlist_add_n(sl, NULL, 0), 0);
+	assert_int_eq("add_n of a prefix", stringlist_add_n(sl, fruit + 1, 1), 0);
+	assert_stringlist(sl, "after another add_n", 4, "pear", "apple", "fig", "apple");
+	stringlist_free(sl);
+
+	test("stringlist: Add a list to itself");
+	sl = stringlist_new_arena(fruit);
+	assert_int_eq("add_all(sl, sl) succeeds", stringlist_add_all(sl, sl), 0);
+	assert_stringlist(sl, "doubled list", 6, "pear", "apple", "fig", "pear", "apple", "fig");
+	stringlist_free(sl);
+}
+
+NEW_TEST(stringlist_adopt_take)
+{
+	struct stringlist *sl, *other;
+	struct strtab *tab;
+	char *strs[3], *s;
+
+	test("stringlist: Adopt strings without copying them");
+	sl = stringlist_new(NULL);
+	s = strdup("banana");
+	assert_int_eq("adopt succeeds", stringlist_adopt(sl, s), 0);
+	assert_ptr_eq("list holds the adopted pointer", sl->strings[0], s);
+	strs[0] = strdup("cherry");
+	strs[1] = strdup("apple");
+	strs[2] = strdup("date");
+	assert_int_eq("adopt_n succeeds", stringlist_adopt_n(sl, strs, 3), 0);
+	assert_stringlist(sl, "after adopt_n", 4, "banana", "cherry", "apple", "date");
+	assert_ptr_eq("list holds adopted pointers", sl->strings[2], strs[1]);
+
+	test("stringlist: Take strings back out");
+	assert_null("cannot take past the end", stringlist_take(sl, 4));
+	s = stringlist_take(sl, 1);
+	assert_ptr_eq("take returns the stored pointer", s, strs[0]);
+	assert_stringlist(sl, "after take", 3, "banana", "apple", "date");
+	assert_int_eq("re-adopt taken string", stringlist_adopt(sl, s), 0);
+	assert_stringlist(sl, "after re-adopt", 4, "banana", "apple", "date", "cherry");
+	stringlist_free(sl);
+
+	test("stringlist: Adopt into an indexed, sorted list");
+	sl = stringlist_new(NULL);
+	stringlist_add(sl, "a");
+	stringlist_add(sl, "c");
+	stringlist_sort(sl, STRINGLIST_SORT_ASC);
+	assert_int_eq("index the list", stringlist_index(sl), 0);
+	assert_int_eq("adopt 'd'", stringlist_adopt(sl, strdup("d")), 0);
+	assert_int_eq("'d' is found", stringlist_search(sl, "d"), 0);
+	assert_int_eq("adopt 'b'", stringlist_adopt(sl, strdup("b")), 0);
+	assert_int_eq("'b' is found", stringlist_search(sl, "b"), 0);
+	s = stringlist_take(sl, 0);
+	assert_str_eq("took 'a'", s, "a");
+	free(s);
+	assert_int_ne("'a' is gone", stringlist_search(sl, "a"), 0);
+	assert_stringlist(sl, "indexed list", 3, "c", "d", "b");
+	stringlist_free(sl);
+
+	test("stringlist: Split and dup lists own their strings one by one");
+	sl = stringlist_split("a b c", 5, " ", SPLIT_NORMAL);
+	s = strdup("d");
+	assert_int_eq("adopt into a split list", stringlist_adopt(sl, s), 0);
+	assert_ptr_eq("split list holds the adopted pointer", sl->strings[3], s);
+	other = stringlist_dup(sl);
+	s = other->strings[0];
+	assert_ptr_eq("take from a dup'd list returns the stored pointer",
+		stringlist_take(other, 0), s);
+	free(s);
+	s = stringlist_take(sl, 0);
+	assert_str_eq("take from a split list", s, "a");
+	free(s);
+	free(sl->strings[0]);
+	sl->strings[0] = strdup("B");
+	assert_stringlist(sl, "entries can be freed and replaced", 3, "B", "c", "d");
+	stringlist_free(other);
+	stringlist_free(sl);
+
+	sl = stringlist_split("a b c", 5, " ", SPLIT_ARENA);
+	assert_stringlist(sl, "arena-backed split", 3, "a", "b", "c");
+	other = stringlist_dup(sl);
+	strs[0] = other->strings[0];
+	s = stringlist_take(other, 0);
+	assert_ptr_ne("dup of an arena list is arena-backed", s, strs[0]);
+	assert_str_eq("take from an arena dup", s, "a");
+	free(s);
+	stringlist_free(other);
+	stringlist_free(sl);
+
+	test("stringlist: Adopt and take with arena and interned lists");
+	sl = stringlist_new_arena(NULL);
+	assert_int_eq("adopt into an arena", stringlist_adopt(sl, strdup("fig")), 0);
+	s = stringlist_take(sl, 0);
+	assert_str_eq("take from an arena", s, "fig");
+	assert_int_eq("arena list is empty", sl->num, 0);
+	free(s);
+	stringlist_free(sl);
+
+	tab = strtab_new();
+	sl = stringlist_new_interned(NULL, tab);
+	assert_int_eq("adopt into an interned list", stringlist_adopt(sl, strdup("kiwi")), 0);
+	assert_ptr_eq("adopted string is interned", sl->strings[0], strtab_intern(tab, "kiwi"));
+	s = stringlist_take(sl, 0);
+	assert_str_eq("take from an interned list", s, "kiwi");
+	assert_ptr_ne("taken string is a copy", s, strtab_intern(tab, "kiwi"));
+	free(s);
+	stringlist_free(sl);
+	strtab_free(tab);
+}
+
+static int has_prefix(const char *s, void *ctx)
+{
+	return strncmp(s, (const char *)ctx, strlen((const char *)ctx)) == 0;
+}
+
+static int is_odd(const char *s, void *ctx)
+{
+	(void)ctx;
+	return (atoi(s + 4) % 2) == 1;
+}
+
+NEW_TEST(stringlist_remove_if)
+{
+	struct stringlist *sl;
+	char buf[32];
+	size_t i;
+
+	test("stringlist: Remove strings matching a predicate");
+	sl = setup_list("apple", "banana", "apricot", "cherry", "avocado", NULL);
+	assert_int_eq("remove a* strings", stringlist_remove_if(sl, has_prefix, "a"), 3);
+	assert_stringlist(sl, "after remove_if", 2, "banana", "cherry");
+	assert_int_eq("nothing else matches", stringlist_remove_if(sl, has_prefix, "a"), 0);
+	assert_stringlist(sl, "after no-op remove_if", 2, "banana", "cherry");
+	stringlist_free(sl);
+
+	test("stringlist: Retain strings matching a predicate");
+	sl = setup_list("apple", "banana", "apricot", "cherry", "avocado", NULL);
+	assert_int_eq("retain a* strings", stringlist_retain_if(sl, has_prefix, "a"), 2);
+	assert_stringlist(sl, "after retain_if", 3, "apple", "apricot", "avocado");
+	assert_int_eq("retain b* strings", stringlist_retain_if(sl, has_prefix, "b"), 3);
+	assert_int_eq("list is empty", sl->num, 0);
+	assert_null("list is still NULL-terminated", sl->strings[0]);
+	stringlist_free(sl);
+
+	test("stringlist: Remove many strings from a large, indexed list");
+	sl = stringlist_new_arena(NULL);
+	for (i = 0; i < 100000; i++) {
+		snprintf(buf, sizeof(buf), "item%lu", (unsigned long)i);
+		stringlist_add(sl, buf);
+	}
+	assert_int_eq("index the list", stringlist_index(sl), 0);
+	assert_int_eq("remove odd items", stringlist_remove_if(sl, is_odd, NULL), 50000);
+	assert_int_eq("half the list is left", sl->num, 50000);
+	assert_str_eq("first item kept", sl->strings[0], "item0");
+	assert_str_eq("order is kept", sl->strings[1], "item2");
+	assert_str_eq("last item kept", sl->strings[49999], "item99998");
+	assert_int_ne("odd items are gone", stringlist_search(sl, "item3"), 0);
+	assert_int_eq("even items are found", stringlist_search(sl, "item4"), 0);
+	stringlist_free(sl);
+}
+
 NEW_TEST(stringlist_remove_all)
 {
 	struct stringlist *sl1, *sl2;
@@ -464,6 +982,104 @@ NEW_TEST(stringlist_qsort)
 	stringlist_free(sl);
 }
 
+static int by_strcmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+NEW_TEST(stringlist_sort_strings)
+{
+	struct stringlist *sl;
+	char **expect, buf[64];
+	size_t i, j, len;
+	int ok, round;
+
+	test("stringlist: Sorting strings with shared prefixes");
+	srand(40);
+	for (ok = 1, round = 0; round < 20 && ok; round++) {
+		sl = stringlist_new(NULL);
+		for (i = 0; i < 2000; i++) {
+			len = rand() % 40;
+			for (j = 0; j < len; j++) {
+				/* mostly shared prefixes, with the odd high-bit byte */
+				buf[j] = j < 20 && rand() % 4 ? '/' : "ab\xc3\x7f"[rand() % 4];
+			}
+			buf[len] = '\0';
+			stringlist_add(sl, buf);
+		}
+
+		expect = calloc(sl->num, sizeof(char *));
+		memcpy(expect, sl->strings, sl->num * sizeof(char *));
+		qsort(expect, sl->num, sizeof(char *), by_strcmp);
+
+		stringlist_sort(sl, STRINGLIST_SORT_ASC);
+		for (i = 0; i < sl->num && ok; i++) {
+			ok = strcmp(sl->strings[i], expect[i]) == 0;
+		}
+		stringlist_sort(sl, STRINGLIST_SORT_DESC);
+		for (i = 0; i < sl->num && ok; i++) {
+			ok = strcmp(sl->strings[i], expect[sl->num - 1 - i]) == 0;
+		}
+
+		free(expect);
+		stringlist_free(sl);
+	}
+	assert_true("sorted order matches strcmp", ok);
+}
+
+static int by_length(const void *a, const void *b)
+{
+	size_t la = strlen(*(char * const *)a), lb = strlen(*(char * const *)b);
+	return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+NEW_TEST(stringlist_sort_parallel)
+{
+	struct stringlist *a, *b;
+	char buf[32];
+	size_t i;
+	int ok, nthreads;
+
+	test("stringlist: Parallel sorting");
+	a = stringlist_new_arena(NULL);
+	srand(41);
+	for (i = 0; i < 200000; i++) {
+		snprintf(buf, sizeof(buf), "/data/%d/%x", rand() % 100, rand());
+		stringlist_add(a, buf);
+	}
+
+	/* 200k strings is enough for 3 threads (an odd number of runs) */
+	for (ok = 1, nthreads = 2; nthreads <= 3 && ok; nthreads++) {
+		b = stringlist_dup(a);
+		assert_int_eq("stringlist_sort_parallel returns 0",
+			stringlist_sort_parallel(b, nthreads % 2 ? STRINGLIST_SORT_ASC : STRINGLIST_SORT_DESC, nthreads), 0);
+		stringlist_sort(a, nthreads % 2 ? STRINGLIST_SORT_ASC : STRINGLIST_SORT_DESC);
+		for (i = 0; i < a->num && ok; i++) {
+			ok = strcmp(a->strings[i], b->strings[i]) == 0;
+		}
+		stringlist_free(b);
+	}
+	assert_true("same order as stringlist_sort", ok);
+
+	test("stringlist: Parallel sorting with a custom comparator");
+	b = stringlist_dup(a);
+	stringlist_sort_parallel(b, by_length, 3);
+	for (ok = 1, i = 1; i < b->num && ok; i++) {
+		ok = strlen(b->strings[i - 1]) <= strlen(b->strings[i]);
+	}
+	assert_true("sorted by length", ok);
+	assert_int_eq("nothing lost", b->num, a->num);
+	stringlist_free(b);
+
+	test("stringlist: Parallel sorting of small lists");
+	b = setup_list("pear", "apple", "fig", NULL);
+	assert_int_eq("stringlist_sort_parallel returns 0", stringlist_sort_parallel(b, STRINGLIST_SORT_ASC, 8), 0);
+	assert_stringlist(b, "small list, sorted", 3, "apple", "fig", "pear");
+	stringlist_free(b);
+
+	stringlist_free(a);
+}
+
 NEW_TEST(stringlist_uniq)
 {
 	const char *a = "alice";
@@ -500,6 +1116,39 @@ NEW_TEST(stringlist_uniq_already)
 	stringlist_free(sl);
 }
 
+NEW_TEST(stringlist_dedup)
+{
+	struct stringlist *sl;
+	char buf[32];
+	size_t i;
+	int ok;
+
+	test("stringlist: Dedup (order-preserving)");
+	sl = setup_list("pear", "banana", "pear", "apple", "banana", "", "pear", "", NULL);
+	assert_int_eq("stringlist_dedup returns 0", stringlist_dedup(sl), 0);
+	assert_stringlist(sl, "post-dedup sl", 4, "pear", "banana", "apple", "");
+	assert_null("list is still NULL-terminated", sl->strings[sl->num]);
+
+	assert_int_eq("stringlist_dedup returns 0", stringlist_dedup(sl), 0);
+	assert_stringlist(sl, "dedup is idempotent", 4, "pear", "banana", "apple", "");
+	stringlist_free(sl);
+
+	test("stringlist: Dedup (many strings)");
+	sl = stringlist_new(NULL);
+	for (i = 0; i < 30000; i++) {
+		snprintf(buf, sizeof(buf), "tag-%lu", (unsigned long)(i * 7 % 1000));
+		stringlist_add(sl, buf);
+	}
+	assert_int_eq("stringlist_dedup returns 0", stringlist_dedup(sl), 0);
+	assert_int_eq("1000 distinct strings left", sl->num, 1000);
+	for (ok = 1, i = 0; i < sl->num && ok; i++) {
+		snprintf(buf, sizeof(buf), "tag-%lu", (unsigned long)(i * 7 % 1000));
+		ok = strcmp(sl->strings[i], buf) == 0;
+	}
+	assert_true("first occurrences kept, in order", ok);
+	stringlist_free(sl);
+}
+
 NEW_TEST(stringlist_diff)
 {
 	const char *a = "alice";
@@ -590,6 +1239,61 @@ NEW_TEST(stringlist_join)
 	stringlist_free(empty);
 }
 
+NEW_TEST(stringlist_join_into)
+{
+	struct stringlist *list = setup_list("item1","item2","item3", NULL);
+	struct stringlist *empty = stringlist_new(NULL);
+	struct stringlist *big;
+	struct string *s;
+	char buf[32], *joined;
+	size_t i;
+	FILE *io;
+
+	test("stringlist: Join stringlist onto a dynamic string");
+	s = string_new("list: ", 4);
+	assert_int_eq("join_into succeeds", stringlist_join_into(s, list, ", "), 0);
+	assert_str_eq("joined onto the string", s->raw, "list: item1, item2, item3");
+	assert_int_eq("length is updated", s->len, strlen("list: item1, item2, item3"));
+	assert_int_eq("join_into an empty list", stringlist_join_into(s, empty, ", "), 0);
+	assert_str_eq("nothing appended", s->raw, "list: item1, item2, item3");
+	assert_int_eq("append after join", string_append(s, "!"), 0);
+	assert_str_eq("string is still usable", s->raw, "list: item1, item2, item3!");
+	string_free(s);
+
+	test("stringlist: Join a large stringlist onto a dynamic string");
+	big = stringlist_new_arena(NULL);
+	for (i = 0; i < 10000; i++) {
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)i);
+		stringlist_add(big, buf);
+	}
+	s = string_new(NULL, 0);
+	joined = stringlist_join(big, "/");
+	assert_int_eq("join_into succeeds", stringlist_join_into(s, big, "/"), 0);
+	assert_str_eq("same as stringlist_join", s->raw, joined);
+	string_free(s);
+
+	test("stringlist: Join stringlist to a file descriptor");
+	io = tmpfile();
+	assert_not_null("(test sanity) tmpfile must return a valid FILE", io);
+	if (!io) { return; }
+	assert_int_eq("join_fd succeeds", stringlist_join_fd(fileno(io), list, "::"), 0);
+	assert_int_eq("join_fd of an empty list", stringlist_join_fd(fileno(io), empty, "::"), 0);
+	assert_fd_contents("joined output written to fd", fileno(io), "item1::item2::item3");
+	fclose(io);
+
+	io = tmpfile();
+	if (!io) { return; }
+	assert_int_eq("join_fd of a large list", stringlist_join_fd(fileno(io), big, "/"), 0);
+	assert_int_eq("all of the output was written",
+		lseek(fileno(io), 0, SEEK_END), strlen(joined));
+	fclose(io);
+	free(joined);
+
+	stringlist_free(list);
+	stringlist_free(empty);
+	stringlist_free(big);
+}
+
 NEW_TEST(stringlist_split)
 {
 	struct stringlist *list;
@@ -620,6 +1324,311 @@ NEW_TEST(stringlist_split)
 	stringlist_free(list);
 }
 
+static void write_file(const char *path, const char *data, size_t len)
+{
+	FILE *io = fopen(path, "w");
+	if (io) {
+		fwrite(data, 1, len, io);
+		fclose(io);
+	}
+}
+
+NEW_TEST(stringlist_from_file)
+{
+	struct stringlist *list;
+	char path[] = "/tmp/gear-test.XXXXXX";
+	char *big, *s;
+	size_t page;
+	int fd;
+
+	fd = mkstemp(path);
+	assert_int_ge("(test sanity) mkstemp must create a file", fd, 0);
+	if (fd < 0) { return; }
+	close(fd);
+
+	test("stringlist: Load lines from a file");
+	write_file(path, "apple\nbanana\n\ncherry\n", 21);
+	list = stringlist_from_file(path, "\n", SPLIT_NORMAL);
+	assert_not_null("from_file returns a list", list);
+	assert_stringlist(list, "lines from file", 4, "apple", "banana", "", "cherry");
+	stringlist_free(list);
+
+	list = stringlist_from_file(path, "\n", SPLIT_GREEDY);
+	assert_stringlist(list, "greedy lines from file", 3, "apple", "banana", "cherry");
+
+	test("stringlist: Add to a list loaded from a file");
+	assert_int_eq("add a string", stringlist_add(list, "date"), 0);
+	assert_stringlist(list, "after add", 4, "apple", "banana", "cherry", "date");
+	stringlist_sort(list, STRINGLIST_SORT_DESC);
+	assert_stringlist(list, "after sort", 4, "date", "cherry", "banana", "apple");
+	s = stringlist_take(list, 1);
+	assert_str_eq("take a string", s, "cherry");
+	free(s);
+	assert_int_eq("remove a string", stringlist_remove(list, "apple"), 0);
+	assert_stringlist(list, "after remove", 2, "date", "banana");
+	stringlist_free(list);
+
+	test("stringlist: Load a file with no trailing delimiter");
+	write_file(path, "one::two::three", 15);
+	list = stringlist_from_file(path, "::", SPLIT_NORMAL);
+	assert_stringlist(list, "tokens from file", 3, "one", "two", "three");
+	stringlist_free(list);
+
+	list = stringlist_from_file(path, "::", SPLIT_COPY);
+	assert_stringlist(list, "copied tokens from file", 3, "one", "two", "three");
+	list->strings[0][0] = 'O';
+	assert_str_eq("copied tokens can be modified", list->strings[0], "One");
+	stringlist_free(list);
+
+	test("stringlist: Load a file that fills its last page");
+	page = sysconf(_SC_PAGESIZE);
+	big = malloc(page);
+	memset(big, 'x', page);
+	big[9] = '\n';
+	write_file(path, big, page);
+	list = stringlist_from_file(path, "\n", SPLIT_NORMAL);
+	assert_int_eq("two lines", list->num, 2);
+	assert_int_eq("first line", strlen(list->strings[0]), 9);
+	assert_int_eq("last line ends at the end of the file", strlen(list->strings[1]), page - 10);
+	stringlist_free(list);
+	free(big);
+
+	test("stringlist: Load an empty file");
+	write_file(path, "", 0);
+	list = stringlist_from_file(path, "\n", SPLIT_NORMAL);
+	assert_not_null("from_file returns a list", list);
+	assert_int_eq("list is empty", list->num, 0);
+	stringlist_free(list);
+
+	test("stringlist: Load a file that claims to be empty");
+	list = stringlist_from_file("/proc/self/status", "\n", SPLIT_GREEDY);
+	assert_not_null("from_file returns a list", list);
+	assert_int_gt("/proc file has lines", list->num, 0);
+	assert_int_eq("first line is the process name", strncmp(list->strings[0], "Name:", 5), 0);
+	stringlist_free(list);
+
+	test("stringlist: Load a file that does not exist");
+	unlink(path);
+	assert_null("from_file fails", stringlist_from_file(path, "\n", SPLIT_NORMAL));
+}
+
+NEW_TEST(strview_split)
+{
+	struct strview f[4];
+	char *joined = "apple--mango--pear";
+	char *nulls  = "a space    separated  list";
+
+	test("strview: Split strings into views");
+	assert_int_eq("three tokens", strview_split(f, 4, joined, strlen(joined), "--", 0), 3);
+	assert_ptr_eq("first token points into the source", f[0].p, joined);
+	assert_int_eq("first token length", f[0].len, 5);
+	assert_ptr_eq("second token points into the source", f[1].p, joined + 7);
+	assert_int_eq("second token length", f[1].len, 5);
+	assert_true("third token is 'pear'", strview_eq(f[2], strview_cstr("pear")));
+
+	assert_int_eq("empty tokens are kept", strview_split(f, 4, joined, strlen(joined), "-", 0), 5);
+	assert_int_eq("second token is empty", f[1].len, 0);
+	assert_true("fourth token is empty", strview_eq(f[3], strview_cstr("")));
+
+	assert_int_eq("greedy split skips empty tokens",
+		strview_split(f, 4, nulls, strlen(nulls), " ", SPLIT_GREEDY), 4);
+	assert_true("last token is 'list'", strview_eq(f[3], strview_cstr("list")));
+
+	test("strview: Split with too little room");
+	f[1] = strview("untouched", 9);
+	assert_int_eq("all tokens are counted", strview_split(f, 1, joined, strlen(joined), "--", 0), 3);
+	assert_true("first token stored", strview_eq(f[0], strview_cstr("apple")));
+	assert_true("nothing stored past max", strview_eq(f[1], strview_cstr("untouched")));
+	assert_int_eq("count only", strview_split(NULL, 0, joined, strlen(joined), "--", 0), 3);
+
+	assert_int_eq("empty string has no tokens", strview_split(f, 4, joined, 0, "--", 0), 0);
+	assert_int_eq("empty delimiter fails", strview_split(f, 4, joined, strlen(joined), "", 0), -1);
+}
+
+static int same_list(struct stringlist *a, struct stringlist *b)
+{
+	size_t i;
+	if (!a || !b || a->num != b->num) { return 0; }
+	for (i = 0; i < a->num; i++) {
+		if (strcmp(a->strings[i], b->strings[i]) != 0) { return 0; }
+	}
+	return b->strings[b->num] == NULL;
+}
+
+NEW_TEST(stringlist_split_parallel)
+{
+	struct stringlist *one, *par;
+	char *buf, *p;
+	size_t i, len = 3 * 1024 * 1024;
+	int nthreads, opt;
+
+	/* lines of assorted lengths, some empty, with \r\n line endings */
+	p = buf = malloc(len + 64);
+	for (i = 0; (size_t)(p - buf) < len; i++) {
+		p += sprintf(p, "%s%lu\r\n", i % 7 == 0 ? "" : "line-", (unsigned long)(i * 7919 % 100003));
+		if (i % 5 == 0) { p += sprintf(p, "\r\n"); }
+	}
+	len = p - buf;
+
+	test("stringlist: Split a large buffer in parallel");
+	for (opt = SPLIT_NORMAL; opt <= SPLIT_GREEDY; opt++) {
+		one = stringlist_split(buf, len, "\r\n", opt);
+		for (nthreads = 1; nthreads <= 4; nthreads++) {
+			par = stringlist_split_parallel(buf, len, "\r\n", opt, nthreads);
+			assert_true("parallel split matches a serial one", same_list(one, par));
+			stringlist_free(par);
+		}
+		stringlist_free(one);
+
+		one = stringlist_split(buf, len, "\n", opt);
+		par = stringlist_split_parallel(buf, len, "\n", opt, 3);
+		assert_true("parallel split on one byte matches", same_list(one, par));
+		assert_int_eq("can add to the result", stringlist_add(par, "more"), 0);
+		assert_str_eq("added string is last", par->strings[par->num - 1], "more");
+		stringlist_free(par);
+		stringlist_free(one);
+	}
+
+	test("stringlist: Split a large buffer on few delimiters in parallel");
+	one = stringlist_split(buf, len, "line-99999\r\n", SPLIT_NORMAL);
+	par = stringlist_split_parallel(buf, len, "line-99999\r\n", SPLIT_NORMAL, 4);
+	assert_true("chunks with no delimiters are handled", same_list(one, par));
+	stringlist_free(par);
+	stringlist_free(one);
+
+	test("stringlist: Split on a self-overlapping delimiter in parallel");
+	memset(buf, '-', len);
+	buf[0] = 'a';
+	buf[len - 1] = 'b';
+	one = stringlist_split(buf, len, "--", SPLIT_NORMAL);
+	par = stringlist_split_parallel(buf, len, "--", SPLIT_NORMAL, 4);
+	assert_true("overlapping delimiters are split serially", same_list(one, par));
+	stringlist_free(par);
+	stringlist_free(one);
+
+	test("stringlist: Split a small buffer in parallel");
+	par = stringlist_split_parallel("a:b::c", 6, ":", SPLIT_GREEDY, 0);
+	assert_stringlist(par, "small parallel split", 3, "a", "b", "c");
+	stringlist_free(par);
+
+	free(buf);
+}
+
+NEW_TEST(stringlist_split_set)
+{
+	struct stringlist *list;
+	struct split_iter it;
+	struct strview tok;
+	struct byteset ws, sep;
+	char *line = "  ts=1700000000\thost=web01  \r\n cpu=0.75\t\t";
+	char *big;
+	size_t i, n;
+
+	byteset_init(&ws, " \t\r\n", 4);
+	byteset_init(&sep, ",;|", 3);
+
+	test("stringlist: Split on any of a set of bytes");
+	list = stringlist_split_set("a,b;c|d", 7, &sep, SPLIT_NORMAL);
+	assert_stringlist(list, "split on ,;|", 4, "a", "b", "c", "d");
+	stringlist_free(list);
+
+	list = stringlist_split_set("a,,b;", 5, &sep, SPLIT_NORMAL);
+	assert_stringlist(list, "empty tokens kept", 3, "a", "", "b");
+	stringlist_free(list);
+
+	test("stringlist: Split on runs of whitespace");
+	list = stringlist_split_set(line, strlen(line), &ws, SPLIT_GREEDY);
+	assert_stringlist(list, "split on whitespace", 3, "ts=1700000000", "host=web01", "cpu=0.75");
+	stringlist_free(list);
+
+	list = stringlist_split_set(" \t ", 3, &ws, SPLIT_GREEDY);
+	assert_int_eq("nothing but whitespace", list->num, 0);
+	stringlist_free(list);
+
+	test("split_iter: Iterate over tokens split on a byteset");
+	split_iter_init_set(&it, "x|y,z", 5, &sep, SPLIT_NORMAL);
+	assert_int_eq("first token found", split_iter_next(&it, &tok), 1);
+	assert_true("first token is 'x'", strview_eq(tok, strview_cstr("x")));
+	assert_int_eq("second token found", split_iter_next(&it, &tok), 1);
+	assert_true("second token is 'y'", strview_eq(tok, strview_cstr("y")));
+	assert_true("tail is the rest of the input", strview_eq(split_iter_tail(&it), strview_cstr("z")));
+	assert_int_eq("third token found", split_iter_next(&it, &tok), 1);
+	assert_true("third token is 'z'", strview_eq(tok, strview_cstr("z")));
+	assert_int_eq("no more tokens", split_iter_next(&it, &tok), 0);
+
+	test("stringlist: Split a large buffer on a byteset");
+	n = 100000;
+	big = malloc(n * 4);
+	for (i = 0; i < n; i++) {
+		memcpy(big + i * 4, "abc", 3);
+		big[i * 4 + 3] = ",;| "[i % 4];
+	}
+	list = stringlist_split_set(big, n * 4, &sep, SPLIT_NORMAL);
+	assert_int_eq("tokens split on ,;| only", list->num, n - n / 4 + 1);
+	assert_str_eq("first token", list->strings[0], "abc");
+	assert_str_eq("token with a space in it", list->strings[3], "abc abc");
+	assert_str_eq("last token", list->strings[list->num - 1], "abc ");
+	stringlist_free(list);
+	free(big);
+}
+
+NEW_TEST(split_iter)
+{
+	struct split_iter it;
+	struct strview tok, tail;
+	struct stringlist *all;
+	char *joined = "apple--mango--pear";
+	char *input  = "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\nX-Empty:\r\nlast";
+	char buf[64];
+	size_t have, chunk, off, i;
+	int ok;
+
+	test("split_iter: Iterate over tokens");
+	split_iter_init(&it, joined, strlen(joined), "--", SPLIT_NORMAL);
+	assert_int_eq("first token found", split_iter_next(&it, &tok), 1);
+	assert_true("first token is 'apple'", strview_eq(tok, strview_cstr("apple")));
+	assert_ptr_eq("token points into the source", tok.p, joined);
+	assert_true("tail is the rest of the input", strview_eq(split_iter_tail(&it), strview_cstr("mango--pear")));
+	assert_int_eq("second token found", split_iter_next(&it, &tok), 1);
+	assert_true("second token is 'mango'", strview_eq(tok, strview_cstr("mango")));
+	assert_int_eq("third token found", split_iter_next(&it, &tok), 1);
+	assert_true("third token is 'pear'", strview_eq(tok, strview_cstr("pear")));
+	assert_int_eq("no more tokens", split_iter_next(&it, &tok), 0);
+	assert_int_eq("nothing left over", split_iter_tail(&it).len, 0);
+
+	split_iter_init(&it, "a  b", 4, " ", SPLIT_GREEDY);
+	assert_int_eq("greedy: first token", split_iter_next(&it, &tok), 1);
+	assert_int_eq("greedy: second token", split_iter_next(&it, &tok), 1);
+	assert_true("greedy: empty token skipped", strview_eq(tok, strview_cstr("b")));
+	assert_int_eq("greedy: no more tokens", split_iter_next(&it, &tok), 0);
+
+	test("split_iter: Stream tokens across buffer refills");
+	all = stringlist_split(input, strlen(input), "\r\n", SPLIT_NORMAL);
+	for (ok = 1, chunk = 1; chunk < sizeof(buf) && ok; chunk++) {
+		split_iter_init(&it, buf, 0, "\r\n", SPLIT_NORMAL | SPLIT_STREAM);
+		off = i = 0;
+		do {
+			tail = split_iter_tail(&it);
+			memmove(buf, tail.p, tail.len);
+			have = strlen(input) - off;
+			if (have > chunk) { have = chunk; }
+			if (have > sizeof(buf) - tail.len) { have = sizeof(buf) - tail.len; }
+			memcpy(buf + tail.len, input + off, have);
+			off += have;
+			split_iter_refill(&it, buf, tail.len + have, have > 0);
+
+			while (split_iter_next(&it, &tok)) {
+				ok = ok && i < all->num && strview_eq(tok, strview_cstr(all->strings[i]));
+				i++;
+			}
+		} while (have > 0);
+		ok = ok && i == all->num;
+	}
+	assert_int_eq("(test sanity) input has 5 lines", all->num, 5);
+	assert_true("streamed tokens match a one-shot split", ok);
+	stringlist_free(all);
+}
+
 NEW_TEST(stringlist_intersect)
 {
 	struct stringlist *X, *Y;
@@ -637,6 +1646,323 @@ NEW_TEST(stringlist_intersect)
 	stringlist_free(Y);
 }
 
+NEW_TEST(stringlist_search_sorted)
+{
+	struct stringlist *sl, *dup;
+	char buf[32];
+	size_t i;
+	int ok;
+
+	test("stringlist: Search a sorted list");
+	sl = setup_list("pear", "banana", "fig", "apple", NULL);
+	stringlist_sort(sl, STRINGLIST_SORT_ASC);
+	assert_int_eq("find 'apple'", stringlist_search(sl, "apple"), 0);
+	assert_int_eq("find 'pear'", stringlist_search(sl, "pear"), 0);
+	assert_int_eq("find 'fig'", stringlist_search(sl, "fig"), 0);
+	assert_int_ne("no 'kiwi'", stringlist_search(sl, "kiwi"), 0);
+	assert_int_ne("no 'aardvark'", stringlist_search(sl, "aardvark"), 0);
+	assert_int_ne("no 'zucchini'", stringlist_search(sl, "zucchini"), 0);
+
+	test("stringlist: Search after adding out of order");
+	stringlist_add(sl, "zucchini");
+	stringlist_add(sl, "cherry");
+	assert_int_eq("find 'cherry'", stringlist_search(sl, "cherry"), 0);
+	assert_int_eq("find 'zucchini'", stringlist_search(sl, "zucchini"), 0);
+	assert_int_eq("find 'apple'", stringlist_search(sl, "apple"), 0);
+
+	test("stringlist: Search a sorted list after removal");
+	stringlist_sort(sl, STRINGLIST_SORT_DESC);
+	assert_int_eq("find 'cherry' (descending)", stringlist_search(sl, "cherry"), 0);
+	stringlist_uniq(sl);
+	assert_int_eq("remove 'fig'", stringlist_remove(sl, "fig"), 0);
+	assert_int_ne("no more 'fig'", stringlist_search(sl, "fig"), 0);
+	assert_int_eq("find 'banana'", stringlist_search(sl, "banana"), 0);
+
+	dup = stringlist_dup(sl);
+	assert_int_eq("find 'zucchini' in dup", stringlist_search(dup, "zucchini"), 0);
+	stringlist_free(dup);
+	stringlist_free(sl);
+
+	test("stringlist: Search a large sorted list");
+	sl = stringlist_new(NULL);
+	for (i = 0; i < 10000; i++) {
+		snprintf(buf, sizeof(buf), "%05lu", (unsigned long)(i * 2));
+		stringlist_add(sl, buf);
+	}
+	stringlist_sort(sl, STRINGLIST_SORT_ASC);
+	for (ok = 1, i = 0; i < 20000 && ok; i++) {
+		snprintf(buf, sizeof(buf), "%05lu", (unsigned long)i);
+		ok = (stringlist_search(sl, buf) == 0) == (i % 2 == 0);
+	}
+	assert_true("binary search finds exactly the even numbers", ok);
+	stringlist_free(sl);
+}
+
+NEW_TEST(stringlist_index)
+{
+	struct stringlist *sl, *other;
+	char buf[32];
+	size_t i;
+	int ok;
+
+	test("stringlist: Indexed search");
+	sl = setup_list("pear", "banana", "pear", NULL);
+	assert_int_eq("stringlist_index succeeds", stringlist_index(sl), 0);
+	assert_int_eq("stringlist_index again is a no-op", stringlist_index(sl), 0);
+	assert_int_eq("find 'pear'", stringlist_search(sl, "pear"), 0);
+	assert_int_ne("no 'kiwi'", stringlist_search(sl, "kiwi"), 0);
+
+	test("stringlist: Index follows adds and removes");
+	stringlist_add(sl, "kiwi");
+	assert_int_eq("find 'kiwi' after add", stringlist_search(sl, "kiwi"), 0);
+	assert_int_eq("remove one 'pear'", stringlist_remove(sl, "pear"), 0);
+	assert_int_eq("other 'pear' still found", stringlist_search(sl, "pear"), 0);
+	assert_int_eq("remove other 'pear'", stringlist_remove(sl, "pear"), 0);
+	assert_int_ne("no more 'pear'", stringlist_search(sl, "pear"), 0);
+	assert_int_ne("removing 'pear' again fails", stringlist_remove(sl, "pear"), 0);
+	stringlist_add(sl, "pear");
+	assert_int_eq("'pear' is back", stringlist_search(sl, "pear"), 0);
+
+	other = setup_list("banana", "fig", NULL);
+	assert_int_eq("add_all succeeds", stringlist_add_all(sl, other), 0);
+	assert_int_eq("find 'fig'", stringlist_search(sl, "fig"), 0);
+	assert_int_eq("remove_all succeeds", stringlist_remove_all(sl, other), 0);
+	assert_int_ne("no more 'banana'", stringlist_search(sl, "banana"), 0);
+	assert_stringlist(sl, "indexed list", 2, "kiwi", "pear");
+
+	stringlist_unindex(sl);
+	assert_int_eq("find 'kiwi' without an index", stringlist_search(sl, "kiwi"), 0);
+
+	stringlist_index(sl);
+	stringlist_free(other);
+	stringlist_free(sl);
+
+	test("stringlist: Index keeps up with churn");
+	sl = stringlist_new(NULL);
+	stringlist_index(sl);
+	for (ok = 1, i = 0; i < 20000; i++) {
+		snprintf(buf, sizeof(buf), "k%lu", (unsigned long)i);
+		ok = ok && stringlist_add(sl, buf) == 0;
+		if (i >= 50) {
+			snprintf(buf, sizeof(buf), "k%lu", (unsigned long)(i - 50));
+			ok = ok && stringlist_remove(sl, buf) == 0
+			        && stringlist_search(sl, buf) != 0;
+		}
+	}
+	for (i = 0; i < 20000; i++) {
+		snprintf(buf, sizeof(buf), "k%lu", (unsigned long)i);
+		ok = ok && (stringlist_search(sl, buf) == 0) == (i >= 20000 - 50);
+	}
+	assert_true("only the last 50 strings are found", ok);
+	assert_int_eq("list holds the last 50 strings", sl->num, 50);
+	stringlist_free(sl);
+}
+
+NEW_TEST(stringlist_set_operations)
+{
+	struct stringlist *a, *b, *r;
+
+	a = setup_list("pear", "apple", "fig", "pear", NULL);
+	b = setup_list("kiwi", "pear", "apple", "pear", NULL);
+
+	test("stringlist: intersection with duplicates");
+	r = stringlist_intersect(a, b);
+	assert_stringlist(r, "a intersect b", 5, "pear", "pear", "apple", "pear", "pear");
+	stringlist_free(r);
+
+	test("stringlist: union");
+	r = stringlist_union(a, b);
+	assert_stringlist(r, "a union b", 4, "pear", "apple", "fig", "kiwi");
+	stringlist_free(r);
+
+	test("stringlist: subtraction");
+	r = stringlist_subtract(a, b);
+	assert_stringlist(r, "a - b", 1, "fig");
+	stringlist_free(r);
+	r = stringlist_subtract(b, a);
+	assert_stringlist(r, "b - a", 1, "kiwi");
+	stringlist_free(r);
+	assert_stringlist(a, "a is unmodified", 4, "pear", "apple", "fig", "pear");
+
+	test("stringlist: set operations on sorted lists");
+	stringlist_sort(a, STRINGLIST_SORT_ASC);
+	stringlist_sort(b, STRINGLIST_SORT_ASC);
+	r = stringlist_intersect(a, b);
+	assert_stringlist(r, "sorted a intersect b", 5, "apple", "pear", "pear", "pear", "pear");
+	stringlist_free(r);
+	r = stringlist_subtract(a, b);
+	assert_stringlist(r, "sorted a - b", 1, "fig");
+	stringlist_free(r);
+
+	assert_int_eq("remove_all on sorted lists", stringlist_remove_all(b, a), 0);
+	assert_stringlist(b, "sorted b - a", 1, "kiwi");
+
+	stringlist_free(a);
+	stringlist_free(b);
+}
+
+NEW_TEST(stringlist_merge)
+{
+	struct stringlist *lists[4], *m, *slow;
+	char buf[32];
+	size_t i, j;
+	int ok;
+
+	test("stringlist: Merge sorted lists");
+	lists[0] = setup_list("apple", "fig", NULL);
+	lists[1] = setup_list("banana", "fig", "kiwi", NULL);
+	lists[2] = stringlist_new(NULL);
+	m = stringlist_merge(lists, 3, 0);
+	assert_stringlist(m, "merged", 5, "apple", "banana", "fig", "fig", "kiwi");
+	assert_int_eq("merged list is searchable", stringlist_search(m, "kiwi"), 0);
+	stringlist_free(m);
+
+	m = stringlist_merge(lists, 3, 1);
+	assert_stringlist(m, "merged (uniq)", 4, "apple", "banana", "fig", "kiwi");
+	stringlist_free(m);
+
+	m = stringlist_merge(lists, 0, 1);
+	assert_int_eq("merge of nothing", m->num, 0);
+	stringlist_free(m);
+
+	test("stringlist: Merge unsorted lists");
+	stringlist_add(lists[2], "cherry");
+	stringlist_add(lists[2], "apple");
+	m = stringlist_merge(lists, 3, 0);
+	assert_stringlist(m, "merged", 7, "apple", "apple", "banana", "cherry", "fig", "fig", "kiwi");
+	stringlist_free(m);
+	m = stringlist_merge(lists, 3, 1);
+	assert_stringlist(m, "merged (uniq)", 5, "apple", "banana", "cherry", "fig", "kiwi");
+	stringlist_free(m);
+	for (i = 0; i < 3; i++) {
+		stringlist_free(lists[i]);
+	}
+
+	test("stringlist: Merge large sorted lists");
+	for (i = 0; i < 4; i++) {
+		lists[i] = stringlist_new_arena(NULL);
+		for (j = 0; j < 20000; j++) {
+			snprintf(buf, sizeof(buf), "key%lu", (unsigned long)((j * (i + 3) * 7919) % 30011));
+			stringlist_add(lists[i], buf);
+		}
+		stringlist_sort(lists[i], STRINGLIST_SORT_ASC);
+	}
+	ok = 1;
+	slow = stringlist_new(NULL);
+	for (i = 0; i < 4; i++) {
+		stringlist_add_all(slow, lists[i]);
+	}
+	stringlist_sort(slow, STRINGLIST_SORT_ASC);
+	m = stringlist_merge(lists, 4, 0);
+	assert_int_eq("merge keeps every string", m->num, slow->num);
+	for (i = 0; ok && i < m->num; i++) {
+		ok = strcmp(m->strings[i], slow->strings[i]) == 0;
+	}
+	assert_true("merge matches add_all + sort", ok);
+	stringlist_free(m);
+
+	stringlist_uniq(slow);
+	m = stringlist_merge(lists, 4, 1);
+	assert_int_eq("uniq merge drops duplicates", m->num, slow->num);
+	for (i = 0; ok && i < m->num; i++) {
+		ok = strcmp(m->strings[i], slow->strings[i]) == 0;
+	}
+	assert_true("uniq merge matches add_all + uniq", ok);
+	stringlist_free(m);
+	stringlist_free(slow);
+	for (i = 0; i < 4; i++) {
+		stringlist_free(lists[i]);
+	}
+}
+
+NEW_TEST(stringlist_set_operations_large)
+{
+	struct stringlist *a, *b, *r;
+	char buf[32];
+	size_t i;
+	int ok;
+
+	test("stringlist: set operations on large lists");
+	a = stringlist_new(NULL);
+	b = stringlist_new(NULL);
+	for (i = 0; i < 50000; i++) {
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)(i * 7919 % 50000));
+		stringlist_add(a, buf);
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)(i * 104729 % 50000 + 25000));
+		stringlist_add(b, buf);
+	}
+
+	r = stringlist_intersect(a, b);
+	assert_int_eq("half of a is in b", r->num, 25000);
+	for (ok = 1, i = 0; i < r->num && ok; i++) {
+		ok = atoi(r->strings[i]) >= 25000;
+	}
+	assert_true("intersection is the upper half", ok);
+	stringlist_free(r);
+
+	r = stringlist_union(a, b);
+	assert_int_eq("a union b has 75000 strings", r->num, 75000);
+	stringlist_free(r);
+
+	assert_int_eq("a and b differ", stringlist_diff(a, b), 0);
+	r = stringlist_dup(a);
+	stringlist_sort(r, STRINGLIST_SORT_DESC);
+	assert_int_ne("a and a (reordered) are equivalent", stringlist_diff(a, r), 0);
+	stringlist_free(r);
+
+	assert_int_eq("remove_all succeeds", stringlist_remove_all(a, b), 0);
+	assert_int_eq("lower half of a is left", a->num, 25000);
+	for (ok = 1, i = 0; i < a->num && ok; i++) {
+		ok = atoi(a->strings[i]) < 25000;
+	}
+	assert_true("only the lower half is left", ok);
+
+	stringlist_free(a);
+	stringlist_free(b);
+}
+
+NEW_TEST(stringlist_set_operations_dups)
+{
+	struct stringlist *a, *b, *r;
+	size_t i;
+
+	test("stringlist: set operations on sorted lists with duplicates");
+	a = setup_list("a", "b", "b", "c", NULL);
+	b = setup_list("b", "b", "b", "c", "c", NULL);
+	stringlist_sort(a, STRINGLIST_SORT_ASC);
+	stringlist_sort(b, STRINGLIST_SORT_ASC);
+	r = stringlist_intersect(a, b);
+	assert_int_eq("every pairing of b and c", r->num, 2 * 3 + 1 * 2);
+	stringlist_free(r);
+	r = stringlist_subtract(a, b);
+	assert_stringlist(r, "a - b", 1, "a");
+	stringlist_free(r);
+	stringlist_free(a);
+	stringlist_free(b);
+
+	test("stringlist: set operations on long runs of duplicates");
+	a = stringlist_new_arena(NULL);
+	b = stringlist_new_arena(NULL);
+	for (i = 0; i < 100000; i++) {
+		stringlist_add(a, "x");
+		stringlist_add(b, "x");
+	}
+	stringlist_add(a, "y");
+	stringlist_add(b, "z");
+	stringlist_sort(a, STRINGLIST_SORT_ASC);
+	stringlist_sort(b, STRINGLIST_SORT_ASC);
+
+	r = stringlist_subtract(a, b);
+	assert_stringlist(r, "a - b", 1, "y");
+	stringlist_free(r);
+	assert_int_eq("a and b differ", stringlist_diff(a, b), 0);
+	assert_int_eq("remove_all succeeds", stringlist_remove_all(a, b), 0);
+	assert_stringlist(a, "after remove_all", 1, "y");
+
+	stringlist_free(a);
+	stringlist_free(b);
+}
+
 NEW_TEST(stringlist_free_null)
 {
 	struct stringlist *sl;
@@ -666,40 +1992,167 @@ NEW_TEST(auto_string)
 
 }
 
+static void* scratch_in_thread(void *ptr)
+{
+	return (void*)string_scratch("thread %s", (const char*)ptr);
+}
+
+NEW_TEST(scratch_string)
+{
+	const char *s, *again;
+	char buf[1025];
+	pthread_t tid;
+	void *other;
+
+	test("MEM: string_scratch() - normal use");
+	s = string_scratch("%s: %u 0x%08x", "Clockwork test build", 1025, 1025);
+	assert_not_null("string_scratch() returns valid pointer", s);
+	assert_str_eq("string_scratch() formats properly", "Clockwork test build: 1025 0x00000401", s);
+
+	again = string_scratch("%u", 42);
+	assert_ptr_eq("string_scratch() reuses its buffer", s, again);
+	assert_str_eq("string_scratch() overwrites the last string", "42", again);
+
+	test("MEM: string_scratch() - large buffer required");
+	memset(buf, 'x', 1024); buf[1024] = '\0';
+	s = string_scratch("%sA%sB", buf, buf);
+	assert_int_eq("s should be 2+(1024*2) octets long", 2+(1024*2), strlen(s));
+	assert_int_eq("'A' is in the right place", s[1024], 'A');
+
+	test("MEM: string_scratch() - per-thread buffers");
+	pthread_create(&tid, NULL, scratch_in_thread, "two");
+	pthread_join(tid, &other);
+	assert_ptr_ne("other threads get their own buffer", other, s);
+	assert_int_eq("this thread's string is intact", s[2049], 'B');
+}
+
+NEW_TEST(string_appendf)
+{
+	struct string *s = string_new("Forty-two", 8);
+	char buf[129];
+
+	test("STRING: Append a formatted string");
+	assert_int_eq("string_appendf returns 0", string_appendf(s, " = %u", 42), 0);
+	assert_auto_string(s, "Forty-two = 42");
+
+	test("STRING: Append a formatted string (with expansion)");
+	memset(buf, 'x', 128); buf[128] = '\0';
+	assert_int_eq("string_appendf returns 0", string_appendf(s, "[%s]", buf), 0);
+	assert_int_eq("string is 14+130 chars long", s->len, 14 + 130);
+	assert_int_eq("string length matches strlen", strlen(s->raw), s->len);
+	assert_int_eq("last character is ']'", s->raw[s->len - 1], ']');
+
+	string_free(s);
+}
+
+NEW_TEST(string_replace_all)
+{
+	struct string *s;
+	const char *src = "a--b--c----d";
+	char *big;
+
+	test("STRING: Replace all occurrences of a string");
+	s = string_replace_all(src, strlen(src), "--", "+");
+	assert_not_null("string_replace_all succeeds", s);
+	assert_str_eq("all '--' replaced", s->raw, "a+b+c++d");
+	assert_int_eq("length is tracked", s->len, 8);
+	string_free(s);
+
+	s = string_replace_all(src, strlen(src), "-", "");
+	assert_str_eq("replace with nothing", s->raw, "abcd");
+	string_free(s);
+
+	s = string_replace_all(src, strlen(src), "---", "<->");
+	assert_str_eq("matches do not overlap", s->raw, "a--b--c<->-d");
+	string_free(s);
+
+	s = string_replace_all(src, 5, "-", "---");
+	assert_str_eq("only $len bytes are considered", s->raw, "a------b---");
+	string_free(s);
+
+	s = string_replace_all(src, strlen(src), "x", "y");
+	assert_str_eq("no match copies the source", s->raw, src);
+	string_free(s);
+
+	assert_null("empty search string is rejected",
+		string_replace_all(src, strlen(src), "", "y"));
+
+	test("STRING: Replace many occurrences with longer strings");
+	big = malloc(100000);
+	memset(big, ',', 100000);
+	s = string_replace_all(big, 100000, ",", ", and then ");
+	assert_not_null("string_replace_all succeeds", s);
+	assert_int_eq("every ',' is replaced", s->len, 1100000);
+	assert_true("output is all replacements",
+		strncmp(s->raw, ", and then , and then ", 22) == 0
+		&& strcmp(s->raw + s->len - 11, ", and then ") == 0);
+	assert_int_le("buffer is at most twice the output", s->bytes, 2 * s->len);
+	assert_int_eq("block size is left alone", s->blk, 100001);
+	string_free(s);
+	free(big);
+}
 
 NEW_SUITE(string)
 {
 	RUN_TEST(string_interpolation);
 	RUN_TEST(string_interpolate_short_stroke);
+	RUN_TEST(string_interpolate_fd);
+	RUN_TEST(string_render);
 	RUN_TEST(string_automatic);
 	RUN_TEST(string_extension);
 	RUN_TEST(string_initial_value);
 	RUN_TEST(string_free_null);
 
+	RUN_TEST(strview);
+	RUN_TEST(strtab);
 
 	RUN_TEST(stringlist_init);
 	RUN_TEST(stringlist_init_with_data);
 	RUN_TEST(stringlist_dup);
+	RUN_TEST(stringlist_interned);
 	RUN_TEST(stringlist_basic_add_remove_search);
+	RUN_TEST(stringlist_addv);
+	RUN_TEST(stringlist_arena);
 	RUN_TEST(stringlist_add_all);
 	RUN_TEST(stringlist_add_all_with_expansion);
+	RUN_TEST(stringlist_reserve_add_n);
+	RUN_TEST(stringlist_adopt_take);
+	RUN_TEST(stringlist_remove_if);
 	RUN_TEST(stringlist_remove_all);
 	RUN_TEST(stringlist_expansion);
 	RUN_TEST(stringlist_remove_nonexistent);
 	RUN_TEST(stringlist_qsort);
+	RUN_TEST(stringlist_sort_strings);
+	RUN_TEST(stringlist_sort_parallel);
 	RUN_TEST(stringlist_uniq);
 	RUN_TEST(stringlist_uniq_already);
+	RUN_TEST(stringlist_dedup);
 
 	RUN_TEST(stringlist_diff);
 	RUN_TEST(stringlist_diff_non_uniq);
 	RUN_TEST(stringlist_diff_single_string);
 
 	RUN_TEST(stringlist_join);
+	RUN_TEST(stringlist_join_into);
 	RUN_TEST(stringlist_split);
+	RUN_TEST(stringlist_split_parallel);
+	RUN_TEST(stringlist_from_file);
+	RUN_TEST(strview_split);
+	RUN_TEST(split_iter);
+	RUN_TEST(stringlist_split_set);
 
 	RUN_TEST(stringlist_intersect);
+	RUN_TEST(stringlist_search_sorted);
+	RUN_TEST(stringlist_index);
+	RUN_TEST(stringlist_set_operations);
+	RUN_TEST(stringlist_set_operations_large);
+	RUN_TEST(stringlist_set_operations_dups);
+	RUN_TEST(stringlist_merge);
 
 	RUN_TEST(stringlist_free_null);
 
 	RUN_TEST(auto_string);
+	RUN_TEST(scratch_string);
+	RUN_TEST(string_appendf);
+	RUN_TEST(string_replace_all);
 }